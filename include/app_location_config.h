@@ -0,0 +1,17 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef APP_LOCATION_CONFIG_H
+#define APP_LOCATION_CONFIG_H
+
+#include "at_location_policy.h"
+
+/**
+ * @brief Set the GNSS scan mode and constellation used by the next scan
+ *
+ * The Sidewalk platform keeps a pointer to the config returned by
+ * get_location_cfg() and reads it when a GNSS scan starts.
+ */
+void app_location_gnss_set(const struct at_gnss_choice *choice);
+
+#endif /* APP_LOCATION_CONFIG_H */
@@ -5,6 +5,7 @@
 #define ASSET_TRACKER_H
 
 #include <sid_api.h>
+#include <zephyr/smf.h>
 
 #define BLE_LM (uint32_t)(SID_LINK_TYPE_1)
 #define FSK_LM (uint32_t)(SID_LINK_TYPE_2)
@@ -13,9 +14,11 @@
 #define DEFAULT_AUTO_SCAN_INTERVAL		30		/* seconds */
 
 #define MAX_PAYLOAD_SIZE 19 			// Max payload size limited to Sidewalk CSS limit
+#define TELEMETRY_BATCH_MAX 8			// Max telemetry samples buffered per uplink
 
 #define RECEIVE_TASK_STACK_SIZE (4096)
 #define RECEIVE_TASK_PRIORITY (CONFIG_SIDEWALK_THREAD_PRIORITY + 1)
+#define RECEIVE_TASK_QUEUE_SIZE (4)
 
 #define LINK_DOWN 0
 #define LINK_UP 1
@@ -25,12 +28,12 @@
  */
 struct at_sensors {
 	uint8_t batt;
-	double temp;
-	double hum;
-	double max_accel_x;
-	double max_accel_y;
-	double max_accel_z;
-	double peak_accel;
+	int32_t temp_mc;            // milli degrees C
+	int32_t hum_mpct;           // milli percent RH
+	int32_t accel_x_mg;         // milli g
+	int32_t accel_y_mg;
+	int32_t accel_z_mg;
+	uint32_t peak_accel_mg;     // magnitude of the acceleration vector, milli g
 };
 
 /**
@@ -44,11 +47,69 @@ enum at_sidewalk_state {
 };
 
 /**
- * Application states
+ * Tracker lifecycle states (SMF), see asset_tracker.c
  */
-enum at_state {
-	AT_STATE_INIT,
-	AT_STATE_RUN
+enum at_sm_state {
+	AT_SM_ROOT,
+	AT_SM_INIT,
+	AT_SM_RUNNING,
+	AT_SM_IDLE,
+	AT_SM_SENSING,
+	AT_SM_LOCATING,
+	AT_SM_UPLINKING,
+	AT_SM_BLE_L1,
+	AT_SM_RESTORING,
+	AT_SM_COUNT,
+};
+
+/**
+ * Per-state timing in hardware cycles (k_cycle_get_32)
+ */
+struct at_state_timing {
+	uint32_t entries;
+	uint32_t entry_cycles;
+	uint32_t exit_cycles;
+	uint32_t last_cycles;
+	uint64_t total_cycles;
+};
+
+/**
+ * Per-cycle timing report, in ms
+ */
+struct at_cycle_report {
+	uint32_t count;
+	uint32_t sensing_ms;        // Cycle start to sensor snapshot ready
+	uint32_t loc_scan_ms;       // Location start to scan done
+	uint32_t loc_send_ms;       // Location start to send done
+	uint32_t uplink_ms;         // Telemetry queued to sent
+	uint32_t radio_ms;          // Location start to last radio completion
+	uint32_t total_ms;
+	uint8_t radio_sessions;     // Location and telemetry sends the stack accepted
+	bool bundled;               // Telemetry rode along with the location send
+	/* Radio sessions over all cycles with a location send, per mode */
+	uint32_t separate_cycles;
+	uint32_t separate_sessions;
+	uint32_t bundled_cycles;
+	uint32_t bundled_sessions;
+};
+
+/**
+ * Scan cycle in progress - timestamps are k_cycle_get_32() values, 0 if unset
+ */
+struct at_cycle {
+	bool loc_pending;
+	bool uplink_pending;
+	bool telemetry_bundled;
+	bool loc_sent;
+	uint8_t radio_sessions;
+	uint32_t start;
+	uint32_t sensors_ready;
+	uint32_t loc_start;
+	uint32_t loc_scan_done;
+	uint32_t loc_done;
+	uint32_t uplink_start;
+	uint32_t uplink_done;
+	struct at_cycle_report last;
 };
 
 /**
@@ -60,6 +121,41 @@ struct link_status {
 	uint32_t supported_link_mode[SID_LINK_TYPE_MAX_IDX];
 };
 
+/**
+ * BLE connection wait statistics - wakeups of the asset tracker thread
+ * spent in EVENT_BLE_CONNECTION_WAIT per uplink attempt
+ */
+struct ble_wait_stats {
+	uint32_t attempts;
+	uint32_t wakeups;
+	uint32_t last_wakeups;
+	uint32_t max_wakeups;
+	uint32_t timeouts;
+};
+
+/**
+ * How BLE_L1 brings up the BLE link for an L1 location ping
+ */
+enum ble_l1_path {
+	BLE_L1_PATH_REINIT,         // sid_deinit, BLE-only sid_init, full re-init after
+	BLE_L1_PATH_LINK_SWITCH,    // sid_start/sid_stop of BLE next to the running links
+	BLE_L1_PATH_COUNT,
+};
+
+/**
+ * BLE_L1 switch timing per path
+ */
+struct ble_l1_timing {
+	uint32_t switches;          // BLE link came up
+	uint32_t restores;          // Stack back to the configured links after a switch
+	uint32_t failures;          // Gave up before the BLE link came up
+	uint32_t timeouts;          // BLE_L1 or RESTORING deadline hit
+	uint32_t last_switch_ms;    // BLE_L1 entry to BLE link up
+	uint32_t last_restore_ms;   // Restore start to stack ready
+	uint64_t total_switch_ms;
+	uint64_t total_restore_ms;
+};
+
 /**
  * Application configuration
  */
@@ -70,29 +166,11 @@ struct at_config {
 	uint8_t scan_freq_motion;
 	uint8_t motion_thres;
 	uint8_t scan_freq_static;
+	uint8_t batch_size;
+	uint8_t uplink_ack;
+	uint8_t uplink_retries;
 };
 
-/**
- * Main application context
- */
-typedef struct at_context {
-	struct sid_event_callbacks event_callbacks;
-	struct sid_config sidewalk_config;
-	struct sid_handle *handle;
-	enum at_sidewalk_state sidewalk_state;
-	struct link_status link_status;
-	bool sidewalk_registered;
-	bool stack_started;
-	bool ble_location_pending;  // Waiting for BLE ready to trigger L1 location
-	enum at_state state;
-	bool connection_request;
-	bool motion;
-	uint8_t total_msg;
-	uint8_t cur_msg;
-	struct at_sensors sensors;
-	struct at_config at_conf;
-} at_ctx_t;
-
 /**
  * Application events - simplified for SDK-based location
  */
@@ -115,19 +193,57 @@ typedef enum at_events {
 	EVENT_BLE_LOCATION_READY,   // BLE stack ready, trigger L1 location
 	EVENT_RESTORE_FULL_STACK,   // Restore full stack after BLE location
 	EVENT_FACTORY_RESET,        // Factory reset - clears Sidewalk registration
+	EVENT_SENSORS_READY,        // Sensor work queue published a new snapshot
+	EVENT_LOCATION_SCANNED,     // Location scan done, fragments being sent
+	EVENT_LOCATION_DONE,        // Location send done or failed
+	EVENT_CYCLE_TIMEOUT,        // Scan cycle took too long, abort it
+	EVENT_STORAGE_DRAIN,        // Uplink telemetry held in the flash log
+	EVENT_UPLINK_RETRY,         // Backoff expired for a failed telemetry frame
+	EVENT_BLE_L1_TIMEOUT,       // BLE_L1 or RESTORING ran out of time
+	AT_EVENT_COUNT,             // Number of events - keep last
 } at_event_t;
 
+/**
+ * Main application context
+ */
+typedef struct at_context {
+	struct smf_ctx smf;         // Must be first - state machine context
+	struct sid_event_callbacks event_callbacks;
+	struct sid_config sidewalk_config;
+	struct sid_handle *handle;
+	enum at_sidewalk_state sidewalk_state;
+	struct link_status link_status;
+	bool sidewalk_registered;
+	bool stack_started;
+	enum at_sm_state sm_state;  // Innermost active state
+	at_event_t event;           // Event being handled by the state machine
+	bool connection_request;
+	bool ble_conn_waiting;      // Blocked until BLE link is up or connection timer expires
+	bool uplink_drain;          // Current uplink only drains the flash log
+	bool motion;
+	uint8_t total_msg;
+	uint8_t cur_msg;
+	struct at_sensors sensors;
+	struct at_config at_conf;
+	struct ble_wait_stats ble_wait;
+	struct ble_l1_timing ble_l1[BLE_L1_PATH_COUNT];
+	struct at_state_timing sm_timing[AT_SM_COUNT];
+	struct at_cycle cycle;
+} at_ctx_t;
+
 /**
  * Received message structure
  */
 struct at_rx_msg {
 	uint16_t msg_id;
 	size_t pld_size;
+	uint32_t rx_cycles;         // k_cycle_get_32() when sid_process() handed it over
 	uint8_t rx_payload[MAX_PAYLOAD_SIZE];
 };
 
 /* Public API */
 void at_event_send(at_event_t event);
+const char *at_sm_state_name(enum at_sm_state state);
 void at_rx_task_msg_q_write(struct at_rx_msg *rx_msg);
 sid_error_t at_thread_init(void);
 
@@ -0,0 +1,84 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef AT_CONFIG_H
+#define AT_CONFIG_H
+
+#include <asset_tracker.h>
+
+/* Valid ranges of the runtime tunable at_config fields */
+#define AT_CONF_MOTION_PERIOD_MIN_M 1
+#define AT_CONF_SCAN_MOTION_MIN_S 30
+#define AT_CONF_SCAN_STATIC_MIN_M 1
+#define AT_CONF_MOTION_THRES_MIN 1
+#define AT_CONF_MOTION_THRES_MAX 127      // LIS3DH INT_THS is 7 bits
+#define AT_CONF_RETRIES_MAX 7
+
+/* at_config fields selected by at_config_stage() */
+#define AT_CONF_LINK_TYPE BIT(0)
+#define AT_CONF_MOTION_PERIOD BIT(1)
+#define AT_CONF_SCAN_MOTION BIT(2)
+#define AT_CONF_MOTION_THRES BIT(3)
+#define AT_CONF_SCAN_STATIC BIT(4)
+#define AT_CONF_BATCH_SIZE BIT(5)
+#define AT_CONF_UPLINK_ACK BIT(6)
+#define AT_CONF_UPLINK_RETRIES BIT(7)
+
+/**
+ * Config persistence statistics
+ */
+struct at_config_stats {
+	uint32_t changes;         // Configs applied at runtime
+	uint32_t writes;          // Flash writes after coalescing
+	uint32_t unchanged;       // Write-backs skipped, flash already up to date
+	uint32_t errors;
+};
+
+/**
+ * @brief Check every field of a configuration against its valid range
+ *
+ * @returns 0 if valid, -EINVAL otherwise
+ */
+int at_config_validate(const struct at_config *conf);
+
+/**
+ * @brief Restore the configuration saved by at_config_apply()
+ *
+ * Leaves conf untouched if nothing valid was saved. Must run before the
+ * first sid_start() so the stack comes up on the saved link type.
+ *
+ * @param conf [in,out] defaults in, persisted configuration out
+ * @returns 0 if a saved configuration was loaded
+ */
+int at_config_load(struct at_config *conf);
+
+/**
+ * @brief Change some configuration fields and hand the result to the tracker thread
+ *
+ * The selected fields are merged, under the config lock, into whatever is
+ * already staged, or into the live configuration if nothing is. Concurrent
+ * changes from the shell and the CONFIG downlink do not undo each other.
+ * The merged configuration is applied as a whole on EVENT_CONFIG_UPDATE, or
+ * not staged at all if it fails validation.
+ *
+ * @param live live configuration, the base when nothing is staged
+ * @param changes new values of the selected fields
+ * @param fields AT_CONF_* bits of the fields to take from changes
+ * @returns 0 on success, -EINVAL if any field is out of range
+ */
+int at_config_stage(const struct at_config *live, const struct at_config *changes,
+		    uint32_t fields);
+
+/**
+ * @brief Apply the staged configuration to the live one and persist it
+ *
+ * Called on the tracker thread only. The flash write is deferred by
+ * CONFIG_CONFIG_SAVE_DELAY_S and restarted by every further change.
+ *
+ * @returns true if a staged configuration was applied
+ */
+bool at_config_apply(struct at_config *live);
+
+void at_config_stats_get(struct at_config_stats *stats);
+
+#endif /* AT_CONFIG_H */
@@ -0,0 +1,57 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef AT_EVENT_QUEUE_H
+#define AT_EVENT_QUEUE_H
+
+#include <zephyr/kernel.h>
+#include <asset_tracker.h>
+
+/**
+ * Events that are idempotent - posting one while it is already pending is a
+ * no-op, so they are kept as pending bits instead of queue entries
+ */
+#define AT_EVENT_COALESCE_MASK                                                                     \
+	(BIT(SIDEWALK_EVENT) | BIT(MOTION_EVENT) | BIT(EVENT_BLE_CONNECTION_WAIT) |                 \
+	 BIT(EVENT_SCAN_SENSORS) | BIT(EVENT_SCAN_LOC) | BIT(EVENT_STORAGE_DRAIN) |                 \
+	 BIT(EVENT_UPLINK_RETRY))
+
+BUILD_ASSERT(AT_EVENT_COUNT <= 32, "Coalescing lane holds at most 32 events");
+
+/**
+ * Per-event dispatcher statistics
+ */
+struct at_event_stats {
+	uint32_t sent[AT_EVENT_COUNT];
+	uint32_t coalesced[AT_EVENT_COUNT];
+	uint32_t dropped[AT_EVENT_COUNT];
+	uint32_t fifo_hwm;        // Max entries seen in the ordered lane
+	uint32_t pending_hwm;     // Max bits seen set in the coalescing lane
+	/* SIDEWALK_EVENT post to sid_process() dispatch latency */
+	uint32_t sid_latency_count;
+	uint32_t sid_latency_last_us;
+	uint32_t sid_latency_mean_us;
+	uint32_t sid_latency_max_us;
+};
+
+/**
+ * @brief Wait for the next event for the asset tracker thread
+ *
+ * SIDEWALK_EVENT is always served first, then the ordered lane in FIFO
+ * order, then the remaining coalesced events.
+ *
+ * @param event [out] next event
+ * @param timeout how long to wait
+ * @returns 0 on success, -EAGAIN on timeout
+ */
+int at_event_get(at_event_t *event, k_timeout_t timeout);
+
+/**
+ * @brief Drop all pending events except SIDEWALK_EVENT
+ */
+void at_event_purge(void);
+
+void at_event_stats_get(struct at_event_stats *stats);
+const char *at_event_name(at_event_t event);
+
+#endif /* AT_EVENT_QUEUE_H */
@@ -0,0 +1,146 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef AT_LOCATION_POLICY_H
+#define AT_LOCATION_POLICY_H
+
+#include <sid_location.h>
+#include <asset_tracker.h>
+
+/* Decisions kept for `tracker location_log` */
+#define LOC_POLICY_LOG_LEN 16
+
+/**
+ * Inputs of one location effort decision
+ */
+struct at_loc_inputs {
+	bool motion;
+	uint8_t batt;             // percent
+	uint32_t link_mask;       // links the stack is started on
+	uint16_t beidou_almanac_age_d;   // UINT16_MAX if unknown
+};
+
+/**
+ * Effort profile handed to sid_location
+ */
+struct at_loc_profile {
+	enum sid_location_effort_mode max_effort;
+	uint32_t l4_to_l3_ms;
+	uint32_t l3_to_l2_ms;
+	uint32_t l2_to_l1_ms;
+};
+
+/**
+ * GNSS scan settings, applied through app_location_gnss_set()
+ */
+enum at_gnss_mode {
+	GNSS_MODE_MOBILE,         // several short scans
+	GNSS_MODE_STATIC,         // one long scan, better accuracy
+	GNSS_MODE_COUNT,
+};
+
+enum at_gnss_constellation {
+	GNSS_CONST_GPS_BEIDOU,
+	GNSS_CONST_GPS,
+	GNSS_CONST_BEIDOU,
+	GNSS_CONST_COUNT,
+};
+
+struct at_gnss_choice {
+	enum at_gnss_mode mode;
+	enum at_gnss_constellation constellation;
+	const char *reason;
+};
+
+/**
+ * GNSS scans and fixes per scan mode and constellation
+ */
+struct at_gnss_stats {
+	uint32_t scans;
+	uint32_t fixes;
+	uint32_t last_ms;
+	uint64_t total_ms;
+	uint64_t fix_ms;          // time of the scans that gave a fix
+};
+
+/**
+ * How a location attempt ended
+ */
+enum at_loc_outcome {
+	AT_LOC_FAILED,            // no result, or it never reached the cloud
+	AT_LOC_SENT,              // result delivered
+	AT_LOC_UNCHANGED,         // WiFi scene unchanged, the last sent result stands
+};
+
+/**
+ * One decision and, once known, its outcome
+ */
+struct at_loc_log_entry {
+	uint32_t uptime_s;
+	uint32_t fix_age_s;       // UINT32_MAX if there was no fix yet
+	uint8_t batt;
+	bool motion;
+	enum sid_location_effort_mode site_effort;   // DEFAULT if unknown
+	enum sid_location_effort_mode max_effort;
+	const char *reason;
+	bool done;
+	enum at_loc_outcome outcome;
+	enum sid_location_effort_mode result_effort;
+	uint32_t duration_ms;     // decision to scan result
+};
+
+/**
+ * @brief Pick the effort profile for the next location scan and log it
+ */
+void at_loc_policy_decide(const struct at_loc_inputs *in, struct at_loc_profile *profile);
+
+/**
+ * @brief Pick the GNSS scan mode and constellation for a scan that may use GNSS
+ *
+ * A choice set with at_loc_policy_gnss_override() takes precedence.
+ */
+void at_loc_policy_gnss(const struct at_loc_inputs *in, struct at_gnss_choice *choice);
+
+/**
+ * @brief Force the GNSS choice, or return it to the policy
+ *
+ * @param choice choice to use for every scan, NULL for the policy
+ */
+void at_loc_policy_gnss_override(const struct at_gnss_choice *choice);
+
+void at_loc_policy_gnss_stats_get(struct at_gnss_stats stats[GNSS_MODE_COUNT][GNSS_CONST_COUNT]);
+
+/**
+ * @brief Report that the last decided scan produced a result
+ *
+ * Stops the scan timing. The outcome follows once the result is sent or
+ * dropped.
+ *
+ * @param effort effort level the scan ended at
+ */
+void at_loc_policy_scanned(enum sid_location_effort_mode effort);
+
+/**
+ * @brief Report how the last decided location attempt ended
+ *
+ * Only a result that reached the cloud, or an unchanged WiFi scene whose
+ * last result did, counts as a fix.
+ *
+ * @param outcome how the attempt ended
+ * @param effort effort level the scan ended at
+ */
+void at_loc_policy_outcome(enum at_loc_outcome outcome, enum sid_location_effort_mode effort);
+
+/**
+ * @brief Default profile, used before the first decision
+ */
+void at_loc_policy_default(struct at_loc_profile *profile);
+
+/**
+ * @brief Copy the decision log, oldest first
+ *
+ * @returns number of entries copied
+ */
+size_t at_loc_policy_log_get(struct at_loc_log_entry *log, size_t max);
+
+#endif /* AT_LOCATION_POLICY_H */
@@ -0,0 +1,65 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef AT_SCHEDULER_H
+#define AT_SCHEDULER_H
+
+#include <zephyr/kernel.h>
+#include <asset_tracker.h>
+
+/* Delay of the first scan after the device starts moving */
+#define MOTION_PULL_IN_S 5
+
+/* Motion threshold unit - matches the LIS3DH INT_THS LSB at +/-2 g */
+#define MOTION_THRES_MG_PER_LSB 16
+
+/**
+ * Scan scheduler statistics
+ */
+struct at_scheduler_stats {
+	uint32_t motion_events;
+	uint32_t pull_ins;
+	uint32_t scans_motion;
+	uint32_t scans_static;
+	uint32_t interval_s;      // Interval of the last scheduled scan
+};
+
+/**
+ * @brief Initialize the scan scheduler
+ *
+ * @param conf cadence settings, read on every scheduling decision
+ */
+void at_scheduler_init(const struct at_config *conf);
+
+/**
+ * @brief Report motion, pulls the next scan in if the device was parked
+ */
+void at_scheduler_on_motion(void);
+
+/**
+ * @brief Feed an accelerometer snapshot to the software motion detector
+ *
+ * @returns true if the change since the previous snapshot exceeds motion_thres
+ */
+bool at_scheduler_accel_update(const struct at_sensors *sensors);
+
+bool at_scheduler_in_motion(void);
+
+/**
+ * @brief Pick the delay until the next scan and count the scan
+ *
+ * Motion cadence while moving. Once parked the interval doubles on each scan
+ * until it reaches the static cadence. Safe to call from the scan timer ISR.
+ */
+k_timeout_t at_scheduler_next(void);
+
+/**
+ * @brief Re-arm the scan timer after the cadence settings changed
+ *
+ * Restarts the parked back-off, the re-arm is not counted as a scan.
+ */
+void at_scheduler_reconfigure(void);
+
+void at_scheduler_stats_get(struct at_scheduler_stats *stats);
+
+#endif /* AT_SCHEDULER_H */
@@ -0,0 +1,50 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef AT_WIFI_FINGERPRINT_H
+#define AT_WIFI_FINGERPRINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Access points kept from the last sent scan */
+#define WIFI_FP_MAX_AP 16
+
+/**
+ * WiFi scene change detection statistics
+ */
+struct at_wifi_fp_stats {
+	uint32_t compared;        // WiFi scans checked against the last sent one
+	uint32_t suppressed;      // Location sends skipped, scene unchanged
+	uint32_t sent;            // Location sends after a scan-only run
+	uint32_t sent_bytes;
+	uint32_t suppressed_bytes;
+	uint8_t last_similarity;  // percent
+};
+
+/**
+ * @brief Compare a WiFi scan result with the last WiFi scan that was sent
+ *
+ * Similarity is the Jaccard index of the two BSSID sets. The send is only
+ * suppressed while the last sent WiFi fix is younger than
+ * CONFIG_LOC_WIFI_RESEND_M. The reference scene is not changed here.
+ *
+ * @param payload sid_location L3 scan payload
+ * @param size payload length
+ * @returns true if the scene is unchanged and the send can be skipped
+ */
+bool at_wifi_fp_unchanged(const uint8_t *payload, size_t size);
+
+/**
+ * @brief Record a location send after a scan-only run
+ *
+ * @param payload scan payload that was sent
+ * @param size payload length
+ * @param wifi true for an L3 WiFi result, which becomes the reference scene
+ */
+void at_wifi_fp_sent(const uint8_t *payload, size_t size, bool wifi);
+
+void at_wifi_fp_stats_get(struct at_wifi_fp_stats *stats);
+
+#endif /* AT_WIFI_FINGERPRINT_H */
@@ -4,6 +4,35 @@
 #ifndef AT_BATTERY_H
 #define AT_BATTERY_H
 
+/**
+ * Battery measurement statistics
+ */
+struct at_battery_stats {
+	uint32_t samples;
+	uint32_t tx_samples;      // Samples triggered right after a radio TX
+	uint32_t errors;
+	uint32_t mv;              // Last rested battery voltage
+	uint32_t min_mv;          // Lowest voltage seen, usually a post TX sag
+	uint8_t pct;              // State of charge from mv
+};
+
+/**
+ * @brief Start VBAT sampling, every CONFIG_BATTERY_SAMPLE_S seconds
+ */
+int init_at_battery(void);
+
+/**
+ * @brief Sample VBAT now to catch the sag after a radio TX, rate limited
+ */
+void at_battery_tx_done(void);
+
+void at_battery_stats_get(struct at_battery_stats *stats);
+
+/**
+ * @brief Fill in the cached state of charge, never touches the ADC
+ *
+ * @returns 0 on success, -EAGAIN before the first sample
+ */
 int get_batt(struct at_sensors *sensors);
 
-#endif /* AT_BATTERY_H */
\ No newline at end of file
+#endif /* AT_BATTERY_H */
@@ -4,7 +4,48 @@
 #ifndef AT_LIS3DHTR_H
 #define AT_LIS3DHTR_H
 
+/**
+ * Accelerometer FIFO statistics, all zero unless CONFIG_ACCEL_FIFO
+ */
+struct at_accel_stats {
+	uint32_t fifo_reads;      // I2C bursts, one MCU wakeup each
+	uint32_t samples;
+	uint32_t overruns;        // FIFO filled up before it was drained
+	uint32_t impacts;         // Excursions beyond CONFIG_ACCEL_IMPACT_MG from 1 g
+	/* Last uplink window, the samples between two get_accel() calls */
+	uint32_t window_samples;
+	uint32_t peak_mg;
+	uint32_t rms_mg;          // RMS deviation from 1 g
+};
+
 int init_at_lis3dh(void);
+
+/**
+ * @brief Read the accelerometer for the uplink scan
+ *
+ * With CONFIG_ACCEL_FIFO the peak covers every sample since the previous
+ * call, background samples do not reset it.
+ */
 int get_accel(struct at_sensors *sensors);
 
+/**
+ * @brief Read the accelerometer for a background aggregation sample
+ *
+ * Same as get_accel() over its own window.
+ */
+int get_accel_sample(struct at_sensors *sensors);
+
+/**
+ * @brief Arm the LIS3DH activity interrupt, posts MOTION_EVENT on movement
+ *
+ * Inactivity is the absence of activity interrupts for at_config.motion_period,
+ * tracked by the scheduler.
+ *
+ * @param motion_thres activity threshold, MOTION_THRES_MG_PER_LSB per step
+ * @returns 0 on success, -ENOTSUP without CONFIG_LIS2DH_TRIGGER
+ */
+int at_lis3dh_motion_config(uint8_t motion_thres);
+
+void at_lis3dh_stats_get(struct at_accel_stats *stats);
+
 #endif /* AT_LIS3DHTR_H */
\ No newline at end of file
@@ -0,0 +1,53 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef AT_SENSORS_H
+#define AT_SENSORS_H
+
+#include <asset_tracker.h>
+
+#define SENSOR_WQ_STACK_SIZE (2048)
+#define SENSOR_WQ_PRIORITY (CONFIG_SIDEWALK_THREAD_PRIORITY + 2)
+
+/**
+ * Running statistics over the samples taken since the last uplink
+ */
+struct at_sensor_agg {
+	uint32_t count;
+	uint32_t window_ms;
+	int32_t temp_min_mc;
+	int32_t temp_max_mc;
+	int32_t temp_mean_mc;
+	int32_t hum_min_mpct;
+	int32_t hum_max_mpct;
+	int32_t hum_mean_mpct;
+	uint32_t accel_max_mg;
+	uint32_t accel_mean_mg;
+};
+
+int init_at_sensors(void);
+
+/**
+ * @brief Queue a sensor acquisition on the sensor work queue
+ *
+ * EVENT_SENSORS_READY is sent to the asset tracker thread once a complete
+ * snapshot has been published.
+ */
+int at_sensors_request(void);
+
+/**
+ * @brief Copy the latest published sensor snapshot
+ */
+void at_sensors_get(struct at_sensors *sensors);
+
+/**
+ * @brief Summarise the aggregation window and start a new one
+ *
+ * Every sensor read, background or requested, feeds the window. Background
+ * sampling runs every CONFIG_SENSOR_SAMPLE_S seconds when it is not 0.
+ *
+ * @return number of samples in the window that was closed
+ */
+uint32_t at_sensors_agg_take(struct at_sensor_agg *agg);
+
+#endif /* AT_SENSORS_H */
@@ -0,0 +1,47 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef AT_STORAGE_H
+#define AT_STORAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sidewalk/at_telemetry_codec.h>
+
+struct at_storage_stats {
+	uint32_t backlog;	// records waiting to be uplinked
+	uint32_t appended;
+	uint32_t drained;
+	uint32_t overwritten;	// oldest records lost when the ring wrapped
+	uint32_t torn;		// partially written records skipped at boot
+	uint32_t drain_ms;	// time from peek to consume, summed over drains
+	uint32_t capacity;
+};
+
+/**
+ * @brief Mount the telemetry log and recover head and tail after a reset
+ */
+int init_at_storage(void);
+
+/**
+ * @brief Append a telemetry sample to the log, overwriting the oldest sector when full
+ */
+int at_storage_append(const struct telemetry_sample *sample);
+
+/**
+ * @brief Copy up to max of the oldest pending samples without consuming them
+ *
+ * @return number of samples copied, or a negative error
+ */
+int at_storage_peek(struct telemetry_sample *samples, size_t max);
+
+/**
+ * @brief Mark the count oldest pending samples as delivered
+ */
+int at_storage_consume(size_t count);
+
+uint32_t at_storage_backlog(void);
+void at_storage_stats_get(struct at_storage_stats *stats);
+
+#endif /* AT_STORAGE_H */
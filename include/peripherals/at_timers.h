@@ -7,11 +7,22 @@
 #include <zephyr/kernel.h>
 
 void scan_timer_set_and_run(k_timeout_t delay);
+uint32_t scan_timer_remaining_ms(void);
 void ble_conn_timer_set_and_run(void);
 void ble_conn_timer_stop(void);
 void btn_press_timer_set_and_run(void);
 void sm_device_profile_timer_set_and_run(k_timeout_t delay);
 void btn_press_timer_stop(void);
+void cycle_timer_set_and_run(void);
+void cycle_timer_stop(void);
+void uplink_retry_timer_set_and_run(k_timeout_t delay);
+void uplink_retry_timer_stop(void);
+void storage_drain_timer_set_and_run(k_timeout_t delay);
+void ble_l1_timer_set_and_run(k_timeout_t delay);
+void ble_l1_timer_stop(void);
+bool ble_l1_timer_expired(void);
+void restore_retry_timer_set_and_run(void);
+void restore_retry_timer_stop(void);
 
 extern bool ble_timeout;
 
@@ -6,5 +6,48 @@
 
 #include <asset_tracker.h>
 
+/**
+ * Downlink opcodes, byte 0 of every downlink payload
+ */
+enum at_dl_opcode {
+	DL_OPCODE_CONFIG = 0x01,	// Update the scan cadence and motion threshold
+	DL_OPCODE_SCAN_NOW = 0x02,	// Run a full sensing, location and uplink cycle
+	DL_OPCODE_LOCATE = 0x03,	// Run a location scan only
+};
 
-#endif // AT_DOWNLINK_H
\ No newline at end of file
+/* CONFIG downlink field mask, byte 1 */
+#define DL_CONFIG_MOTION_PERIOD BIT(0)
+#define DL_CONFIG_SCAN_MOTION BIT(1)
+#define DL_CONFIG_SCAN_STATIC BIT(2)
+#define DL_CONFIG_MOTION_THRES BIT(3)
+#define DL_CONFIG_SIZE 6
+
+/**
+ * Downlink receive task statistics
+ */
+struct at_downlink_stats {
+	uint32_t received;        // Messages handed over by sid_process()
+	uint32_t dropped;         // Receive queue full
+	uint32_t handled;
+	uint32_t unknown;         // No decoder entry for the opcode
+	uint32_t malformed;       // Payload length outside the opcode's range
+	uint32_t queue_hwm;       // Max messages seen waiting in the queue
+	/* Time from on_msg_received to the handler returning */
+	uint32_t latency_count;
+	uint32_t latency_last_us;
+	uint32_t latency_mean_us;
+	uint32_t latency_max_us;
+};
+
+/**
+ * @brief Start the downlink receive task
+ *
+ * Downlinks are queued by at_rx_task_msg_q_write() from the Sidewalk
+ * callbacks and decoded on their own thread, so command handling never
+ * runs inside sid_process().
+ */
+void at_downlink_init(at_ctx_t *at_ctx);
+
+void at_downlink_stats_get(struct at_downlink_stats *stats);
+
+#endif // AT_DOWNLINK_H
@@ -0,0 +1,51 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef AT_TELEMETRY_CODEC_H
+#define AT_TELEMETRY_CODEC_H
+
+/*
+ * Delta / bit-packed telemetry codec (SENSOR_DELTA, type 0x03).
+ *
+ * Plain C99 with no Zephyr dependencies so the same source can be compiled
+ * into the firmware and into host-side decoders.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_MSG_TYPE_DELTA 0x03
+#define TELEMETRY_DELTA_MAX_RECORDS 63
+
+struct telemetry_sample {
+	uint8_t batt;		// 0-100 %
+	int8_t temp;		// degrees C
+	uint8_t hum;		// 0-100 %
+	bool motion;
+	uint8_t accel;		// peak acceleration, 0-127
+};
+
+/**
+ * Encode as many samples as fit in one frame of buf_size bytes.
+ *
+ * @param samples  samples to encode, oldest first
+ * @param count    number of samples available
+ * @param buf      output frame
+ * @param buf_size frame size limit in bytes
+ * @param encoded  set to the number of samples written to the frame
+ * @return frame length in bytes, or -EINVAL if not even one sample fits
+ */
+int telemetry_delta_encode(const struct telemetry_sample *samples, size_t count,
+			   uint8_t *buf, size_t buf_size, size_t *encoded);
+
+/**
+ * Decode one SENSOR_DELTA frame.
+ *
+ * @return number of samples written to out, -EINVAL for a malformed frame,
+ *         -ENOMEM if out is too small
+ */
+int telemetry_delta_decode(const uint8_t *buf, size_t len,
+			   struct telemetry_sample *out, size_t max_samples);
+
+#endif // AT_TELEMETRY_CODEC_H
@@ -6,8 +6,71 @@
 
 #include <asset_tracker.h>
 
+#define UPLINK_BUF_COUNT 4	// Telemetry frames queued to the stack at once
+#define UPLINK_MTU_MAX 255	// Largest telemetry frame, BLE
+#define UPLINK_BATCH_MAX 32	// Samples per uplink, including ones drained from flash
+#define UPLINK_TELEMETRY_SIZE 5	// Single sample SENSOR_TELEMETRY frame
+
+struct at_uplink_stats {
+	uint32_t queued;
+	uint32_t sent;
+	uint32_t first_try;	// sent without a retry
+	uint32_t retries;
+	uint32_t failed;	// given up on, samples moved to the flash log
+	uint32_t buf_waits;	// frames held back for lack of a free buffer
+	uint32_t encode_fallbacks;	// batches sent as SENSOR_BATCH after a delta encoding error
+	uint8_t in_flight;
+	uint8_t in_flight_hwm;
+	uint16_t mtu;		// frame size limit of the last batch
+};
+
+/**
+ * Add the current sensor snapshot to the telemetry batch
+ *
+ * @return true once the batch is due to be sent
+ */
+bool at_uplink_sample(at_ctx_t *at_ctx);
+
+/**
+ * Send a scan-only location result in one LOCATION_BUNDLE frame with the
+ * next telemetry sample, instead of a location send of its own. The scan
+ * buffer must stay valid until the uplink is packed.
+ *
+ * @return false if the bundle does not fit the link MTU, or the uplink has
+ *         more to carry than the cycle's sample: an aggregate, a batch or
+ *         stored samples
+ */
+bool at_uplink_bundle(at_ctx_t *at_ctx, const uint8_t *scan, size_t size, uint8_t mode);
+
+/**
+ * Take the result of the last bundle at_uplink_bundle() accepted
+ *
+ * @return 0 if it was delivered, -EINPROGRESS while it is queued or in
+ *         flight, -EIO or -EMSGSIZE if it was lost, -ENOENT if there is no
+ *         result to take
+ */
+int at_uplink_bundle_result(void);
+
 void at_send_uplink(at_ctx_t *context);
-void at_msg_sent(at_ctx_t *context);
-void at_send_error(at_ctx_t *context);
+void at_msg_sent(at_ctx_t *context, const struct sid_msg_desc *msg_desc);
+void at_send_error(at_ctx_t *context, const struct sid_msg_desc *msg_desc);
+
+/**
+ * Move telemetry that has not been delivered into the flash log
+ */
+void at_uplink_abort(at_ctx_t *at_ctx);
+
+void at_uplink_stats_get(struct at_uplink_stats *stats);
+
+/**
+ * SENSOR_BATCH records that fit a frame of mtu bytes
+ */
+uint8_t at_uplink_records_per_frame(size_t mtu);
+
+/* Batch sizing helpers for LoRa, also used by the 'tracker batch' report */
+uint8_t at_uplink_batch_frames(uint8_t records);
+size_t at_uplink_batch_bytes(uint8_t records);
+uint32_t at_uplink_airtime_us(size_t payload_size);
+uint32_t at_uplink_batch_airtime_us(uint8_t records);
 
-#endif // AT_UPLINK_H
\ No newline at end of file
+#endif // AT_UPLINK_H
@@ -7,6 +7,8 @@
 #include <lr11xx_gnss_wifi_config.h>
 #include <smtc_modem_geolocation_api.h>
 
+#include "app_location_config.h"
+
 /*
  * GNSS Scan Mode Options:
  *   SMTC_MODEM_GNSS_MODE_MOBILE - Multiple quick scans (~3-5 sec each), for moving objects
@@ -17,7 +19,8 @@
  *   SMTC_MODEM_GNSS_CONSTELLATION_BEIDOU     - BeiDou only
  *   SMTC_MODEM_GNSS_CONSTELLATION_GPS_BEIDOU - Both (more satellites, better coverage)
  *
- * To change scan mode, set CONFIG_GNSS_SCAN_MODE_STATIC=y in prj.conf
+ * CONFIG_GNSS_SCAN_MODE_STATIC=y sets the default scan mode. The location
+ * policy picks the mode and constellation per scan via app_location_gnss_set().
  */
 
 #ifdef CONFIG_GNSS_SCAN_MODE_STATIC
@@ -35,3 +38,16 @@ const lr11xx_gnss_wifi_config_t *get_location_cfg(void)
 {
 	return &gnss_wifi_config;
 }
+
+void app_location_gnss_set(const struct at_gnss_choice *choice)
+{
+	static const smtc_modem_gnss_constellation_t constellations[] = {
+		[GNSS_CONST_GPS_BEIDOU] = SMTC_MODEM_GNSS_CONSTELLATION_GPS_BEIDOU,
+		[GNSS_CONST_GPS] = SMTC_MODEM_GNSS_CONSTELLATION_GPS,
+		[GNSS_CONST_BEIDOU] = SMTC_MODEM_GNSS_CONSTELLATION_BEIDOU,
+	};
+
+	gnss_wifi_config.scan_mode = (choice->mode == GNSS_MODE_STATIC) ?
+				     SMTC_MODEM_GNSS_MODE_STATIC : SMTC_MODEM_GNSS_MODE_MOBILE;
+	gnss_wifi_config.constellation_type = constellations[choice->constellation];
+}
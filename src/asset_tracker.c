@@ -1,10 +1,13 @@
 // Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
 // SPDX-License-Identifier: MIT-0
 
+#include <string.h>
+
 #include <sid_api.h>
 #include <sid_error.h>
 #include <sid_location.h>
 #include <zephyr/kernel.h>
+#include <zephyr/smf.h>
 
 // New SDK v1.19 platform init
 #include <sid_pal_common_ifc.h>
@@ -34,12 +37,21 @@ LOG_MODULE_REGISTER(asset_tracker, CONFIG_TRACKER_LOG_LEVEL);
 
 #ifdef CONFIG_SIDEWALK_SUBGHZ_RADIO_LR1110
 #include <app_location_lr11xx_config.h>
+#include <lr11xx_gnss.h>
+#include "app_location_config.h"
 #endif
 
 #include <asset_tracker.h>
+#include "at_config.h"
+#include "at_event_queue.h"
+#include "at_location_policy.h"
+#include "at_wifi_fingerprint.h"
+#include "at_scheduler.h"
 #include "peripherals/at_battery.h"
 #include "peripherals/at_lis3dh.h"
+#include "peripherals/at_sensors.h"
 #include "peripherals/at_sht41.h"
+#include "peripherals/at_storage.h"
 #include "peripherals/at_timers.h"
 #include "sidewalk/at_uplink.h"
 #include "sidewalk/at_downlink.h"
@@ -49,7 +61,6 @@ LOG_MODULE_REGISTER(asset_tracker, CONFIG_TRACKER_LOG_LEVEL);
 
 static struct k_thread at_thread;
 K_THREAD_STACK_DEFINE(at_thread_stack, CONFIG_SIDEWALK_THREAD_STACK_SIZE);
-K_MSGQ_DEFINE(at_thread_msgq, sizeof(at_event_t), CONFIG_SIDEWALK_THREAD_QUEUE_SIZE, 4);
 
 static at_ctx_t asset_tracker_context = {0};
 
@@ -113,6 +124,21 @@ static void radio_irq_handler(void)
 }
 #endif /* CONFIG_SIDEWALK_SUBGHZ_SUPPORT */
 
+/* Effort profile sid_location is currently initialized with */
+static struct at_loc_profile loc_profile;
+
+/* BeiDou almanac date read from the LR11XX at boot, days since the GPS epoch */
+#define GNSS_BEIDOU_SV_ID 64
+static uint16_t beidou_almanac_date = UINT16_MAX;
+
+/* Scan-only result, held until the WiFi scene has been compared */
+#define LOC_SCAN_BUF_SIZE 256
+static bool loc_scan_only;
+static bool loc_compare_scene;
+static uint8_t loc_scan_buf[LOC_SCAN_BUF_SIZE];
+static size_t loc_scan_size;
+static enum sid_location_effort_mode loc_scan_mode;
+
 /**
  * Location callback - called when location scan/send completes
  */
@@ -123,18 +149,32 @@ static void location_callback(const struct sid_location_result *const result, vo
 	LOG_INF("Location result: status=%d, err=%d, mode=%d, link=%d", 
 		result->status, result->err, result->mode, result->link);
 	
-	if (result->status == SID_LOCATION_SCAN_DONE) {
-		LOG_INF("Location scan complete");
-	} else if (result->status == SID_LOCATION_SEND_DONE) {
-		LOG_INF("Location send complete");
-		// After location is sent, send sensor telemetry
-		at_event_send(EVENT_SEND_UPLINK);
-	}
-	
 	if (result->err != SID_ERROR_NONE) {
 		LOG_ERR("Location error: %d", result->err);
+		at_loc_policy_outcome(AT_LOC_FAILED, result->mode);
 		// Still send sensor telemetry even if location failed
-		at_event_send(EVENT_SEND_UPLINK);
+		at_event_send(EVENT_LOCATION_DONE);
+	} else if (result->status == SID_LOCATION_SCAN_DONE) {
+		LOG_INF("Location scan complete");
+		// The outcome waits for the send, a scan result alone is no fix
+		at_loc_policy_scanned(result->mode);
+		loc_scan_mode = result->mode;
+		if (loc_scan_only) {
+			if (result->size > LOC_SCAN_BUF_SIZE) {
+				LOG_ERR("Location scan result too large: %zu", (size_t)result->size);
+				at_loc_policy_outcome(AT_LOC_FAILED, result->mode);
+				at_event_send(EVENT_LOCATION_DONE);
+				return;
+			}
+			memcpy(loc_scan_buf, result->payload, result->size);
+			loc_scan_size = result->size;
+		}
+		// Queue telemetry now, while the location fragments are in flight
+		at_event_send(EVENT_LOCATION_SCANNED);
+	} else if (result->status == SID_LOCATION_SEND_DONE) {
+		LOG_INF("Location send complete");
+		at_loc_policy_outcome(AT_LOC_SENT, loc_scan_mode);
+		at_event_send(EVENT_LOCATION_DONE);
 	}
 }
 
@@ -143,18 +183,22 @@ static void location_callback(const struct sid_location_result *const result, vo
  */
 static sid_error_t init_location_services(at_ctx_t *at_ctx)
 {
+	if (loc_profile.max_effort == SID_LOCATION_EFFORT_DEFAULT) {
+		at_loc_policy_default(&loc_profile);
+	}
+
 	struct sid_location_config loc_cfg = {
 		.sid_location_type_mask = SID_LOCATION_METHOD_ALL,
-		.max_effort = SID_LOCATION_EFFORT_L4,
+		.max_effort = loc_profile.max_effort,
 		.manage_effort = true,
 		.callbacks = {
 			.on_update = location_callback,
 			.context = at_ctx,
 		},
 		.stepdowns = {
-			.l4_to_l3 = 5000,
-			.l3_to_l2 = 5000,
-			.l2_to_l1 = 5000,
+			.l4_to_l3 = loc_profile.l4_to_l3_ms,
+			.l3_to_l2 = loc_profile.l3_to_l2_ms,
+			.l2_to_l1 = loc_profile.l2_to_l1_ms,
 		},
 		.fragmentation = {
 			.timeout_ms = 30000,
@@ -171,13 +215,65 @@ static sid_error_t init_location_services(at_ctx_t *at_ctx)
 	return err;
 }
 
+/**
+ * Age of the BeiDou almanac, UINT16_MAX until the stack has GPS time
+ */
+static uint16_t beidou_almanac_age_d(at_ctx_t *at_ctx)
+{
+	struct sid_timespec now;
+
+	if (beidou_almanac_date == UINT16_MAX ||
+	    sid_get_time(at_ctx->handle, SID_GPS_TIME, &now) != SID_ERROR_NONE) {
+		return UINT16_MAX;
+	}
+
+	uint32_t today = now.tv_sec / SEC_PER_DAY;
+
+	return (today > beidou_almanac_date) ? MIN(today - beidou_almanac_date, UINT16_MAX - 1) : 0;
+}
+
 /**
  * Trigger a location scan and send
  */
 static void trigger_location_scan(at_ctx_t *at_ctx)
 {
+	struct at_loc_inputs inputs = {
+		.motion = at_scheduler_in_motion(),
+		.batt = at_ctx->sensors.batt,
+		.link_mask = at_ctx->at_conf.sid_link_type,
+		.beidou_almanac_age_d = beidou_almanac_age_d(at_ctx),
+	};
+	struct at_loc_profile profile;
+
+	at_loc_policy_decide(&inputs, &profile);
+
+#ifdef CONFIG_SIDEWALK_SUBGHZ_RADIO_LR1110
+	if (profile.max_effort == SID_LOCATION_EFFORT_L4) {
+		struct at_gnss_choice gnss;
+
+		at_loc_policy_gnss(&inputs, &gnss);
+		app_location_gnss_set(&gnss);
+	}
+#endif
+
+	// Effort and stepdowns are init time settings, re-init only on change
+	if (memcmp(&profile, &loc_profile, sizeof(profile)) != 0) {
+		loc_profile = profile;
+		sid_location_deinit(at_ctx->handle);
+		if (init_location_services(at_ctx) != SID_ERROR_NONE) {
+			at_loc_policy_outcome(AT_LOC_FAILED, SID_LOCATION_EFFORT_DEFAULT);
+			at_event_send(EVENT_LOCATION_DONE);
+			return;
+		}
+	}
+
+	// Parked with WiFi in reach, hold the result back for a scene comparison
+	loc_compare_scene = CONFIG_LOC_WIFI_SIMILARITY_PCT > 0 && !inputs.motion &&
+			    profile.max_effort >= SID_LOCATION_EFFORT_L3;
+	loc_scan_only = loc_compare_scene || IS_ENABLED(CONFIG_LOC_BUNDLE_TELEMETRY);
+
 	struct sid_location_run_config run_cfg = {
-		.type = SID_LOCATION_SCAN_AND_SEND,
+		.type = loc_scan_only ? SID_LOCATION_SCAN_ONLY : SID_LOCATION_SCAN_AND_SEND,
 		.mode = SID_LOCATION_EFFORT_DEFAULT,
 		.buffer = NULL,
 		.size = 0,
@@ -186,22 +282,364 @@ static void trigger_location_scan(at_ctx_t *at_ctx)
 	sid_error_t err = sid_location_run(at_ctx->handle, &run_cfg, 0);
 	if (err != SID_ERROR_NONE) {
 		LOG_ERR("Failed to start location scan: %d", err);
+		at_loc_policy_outcome(AT_LOC_FAILED, SID_LOCATION_EFFORT_DEFAULT);
 		// Fall back to just sending sensor telemetry
-		at_event_send(EVENT_SEND_UPLINK);
+		at_event_send(EVENT_LOCATION_DONE);
 	} else {
 		LOG_INF("Location scan started");
+		if (!loc_scan_only) {
+			at_ctx->cycle.loc_sent = true;
+			at_ctx->cycle.radio_sessions++;
+		}
 	}
 }
 
-static void at_app_entry(void *ctx, void *unused, void *unused2)
+/**
+ * Send a scan-only result, unless it is a WiFi scan of an unchanged scene.
+ * With CONFIG_LOC_BUNDLE_TELEMETRY the result goes out with the telemetry
+ * uplink in a LOCATION_BUNDLE frame when at_uplink_bundle() accepts it.
+ *
+ * @returns true if a location send is in flight
+ */
+static bool send_location_scan(at_ctx_t *at_ctx)
 {
-	at_ctx_t *at_ctx = (at_ctx_t *)ctx;
-	ARG_UNUSED(unused);
-	ARG_UNUSED(unused2);
-	LOG_DBG("Starting %s ...", __FUNCTION__);
-	
-	PRINT_AWSIOT_LOGO();
-	PRINT_AT_VERSION();
+	if (loc_compare_scene && loc_scan_mode == SID_LOCATION_EFFORT_L3 &&
+	    at_wifi_fp_unchanged(loc_scan_buf, loc_scan_size)) {
+		at_loc_policy_outcome(AT_LOC_UNCHANGED, loc_scan_mode);
+		return false;
+	}
+
+	// The outcome of a bundle is known once the uplink is done with it
+	if (IS_ENABLED(CONFIG_LOC_BUNDLE_TELEMETRY) &&
+	    at_uplink_bundle(at_ctx, loc_scan_buf, loc_scan_size, loc_scan_mode)) {
+		at_wifi_fp_sent(loc_scan_buf, loc_scan_size, loc_scan_mode == SID_LOCATION_EFFORT_L3);
+		at_ctx->cycle.loc_sent = true;
+		at_ctx->cycle.telemetry_bundled = true;
+		return false;
+	}
+
+	struct sid_location_run_config run_cfg = {
+		.type = SID_LOCATION_SEND_ONLY,
+		.mode = loc_scan_mode,
+		.buffer = loc_scan_buf,
+		.size = loc_scan_size,
+	};
+
+	sid_error_t err = sid_location_run(at_ctx->handle, &run_cfg, 0);
+	if (err != SID_ERROR_NONE) {
+		LOG_ERR("Failed to send location: %d", err);
+		at_loc_policy_outcome(AT_LOC_FAILED, loc_scan_mode);
+		return false;
+	}
+	at_wifi_fp_sent(loc_scan_buf, loc_scan_size, loc_scan_mode == SID_LOCATION_EFFORT_L3);
+	at_ctx->cycle.loc_sent = true;
+	at_ctx->cycle.radio_sessions++;
+	return true;
+}
+
+/**
+ * End a BLE connection wait and record how many thread wakeups it took
+ */
+static void ble_conn_wait_finish(at_ctx_t *at_ctx)
+{
+	ble_conn_timer_stop();
+	at_ctx->ble_conn_waiting = false;
+	at_ctx->ble_wait.last_wakeups = at_ctx->ble_wait.wakeups;
+	if (at_ctx->ble_wait.wakeups > at_ctx->ble_wait.max_wakeups) {
+		at_ctx->ble_wait.max_wakeups = at_ctx->ble_wait.wakeups;
+	}
+	LOG_INF("BLE connection wait done after %u wakeups", at_ctx->ble_wait.wakeups);
+}
+
+static void at_sid_process(at_ctx_t *at_ctx)
+{
+	sid_error_t err = sid_process(at_ctx->handle);
+	if (err) {
+		LOG_DBG("sid_process returned %d", err);
+	}
+}
+
+static void at_stack_start(at_ctx_t *at_ctx)
+{
+	LOG_INF("EVENT_SID_START: stack_started=%d", at_ctx->stack_started);
+	if (at_ctx->stack_started) {
+		LOG_DBG("Sidewalk stack already started, skipping sid_start");
+		return;
+	}
+
+	sid_error_t err;
+
+	// A restore that gave up may have left no stack to start
+	if (at_ctx->handle == NULL) {
+		err = sid_init(&at_ctx->sidewalk_config, &at_ctx->handle);
+		if (err != SID_ERROR_NONE) {
+			LOG_ERR("sid_init returned %d", err);
+			at_ctx->handle = NULL;
+			return;
+		}
+	}
+
+	LOG_INF("Starting Sidewalk stack with link_type 0x%x...", at_ctx->at_conf.sid_link_type);
+	err = sid_start(at_ctx->handle, at_ctx->at_conf.sid_link_type);
+	if (err) {
+		LOG_ERR("sid_start returned %d", err);
+		return;
+	}
+	at_ctx->stack_started = true;
+	LOG_INF("stack_started set to true");
+	// Re-initialize location services after stack restart
+	sid_location_deinit(at_ctx->handle);
+	init_location_services(at_ctx);
+}
+
+static void at_stack_stop(at_ctx_t *at_ctx)
+{
+	LOG_INF("Going to sleep...");
+	if (at_ctx->ble_conn_waiting) {
+		ble_conn_wait_finish(at_ctx);
+	}
+	if (at_ctx->stack_started) {
+		at_sid_process(at_ctx);
+		LOG_INF("Calling sid_stop with link_type 0x%x", at_ctx->at_conf.sid_link_type);
+		sid_error_t err = sid_stop(at_ctx->handle, at_ctx->at_conf.sid_link_type);
+		LOG_INF("sid_stop returned %d", err);
+		at_ctx->stack_started = false;
+	} else {
+		LOG_DBG("Stack not running, skipping sid_stop");
+	}
+	at_event_purge();
+}
+
+/**
+ * Send the telemetry uplink, requesting a BLE connection first if needed
+ */
+static void at_uplink_start(at_ctx_t *at_ctx)
+{
+	// For BLE, we need to request connection first if link is down
+	if (at_ctx->at_conf.sid_link_type == BLE_LM) {
+		if (at_ctx->sidewalk_state != STATE_SIDEWALK_READY || 
+		    (at_ctx->link_status.link_status_mask & BLE_LM) == 0) {
+			at_event_send(EVENT_BLE_CONNECTION_REQUEST);
+			return;
+		}
+	}
+	// For LoRa, just need time sync - it's connectionless/fire-and-forget
+	// No need to check link_status_mask for LoRa
+	LOG_INF("Sending uplink...");
+	at_send_uplink(at_ctx);
+}
+
+/**
+ * Sample the sensors into the telemetry batch and send it once it is due
+ */
+static void at_uplink_telemetry(at_ctx_t *at_ctx)
+{
+	if (!at_ctx->uplink_drain && !at_uplink_sample(at_ctx)) {
+		// Sample buffered for a later batch, nothing to send this cycle
+		at_event_send(EVENT_UPLINK_COMPLETE);
+		return;
+	}
+	at_uplink_start(at_ctx);
+}
+
+static uint32_t cycle_ms(uint32_t from, uint32_t to)
+{
+	return (from != 0 && to != 0) ? k_cyc_to_ms_floor32(to - from) : 0;
+}
+
+static void at_cycle_begin(at_ctx_t *at_ctx)
+{
+	struct at_cycle *cycle = &at_ctx->cycle;
+	struct at_cycle_report last = cycle->last;
+
+	*cycle = (struct at_cycle){ .start = k_cycle_get_32(), .last = last };
+	cycle_timer_set_and_run();
+}
+
+/**
+ * Log where the time of the cycle just finished went
+ */
+static void at_cycle_end(at_ctx_t *at_ctx)
+{
+	struct at_cycle *cycle = &at_ctx->cycle;
+	struct at_cycle_report *report = &cycle->last;
+	uint32_t now = k_cycle_get_32();
+
+	cycle_timer_stop();
+
+	report->count++;
+	report->sensing_ms = cycle_ms(cycle->start, cycle->sensors_ready);
+	report->loc_scan_ms = cycle_ms(cycle->loc_start, cycle->loc_scan_done);
+	report->loc_send_ms = cycle_ms(cycle->loc_start, cycle->loc_done);
+	report->uplink_ms = cycle_ms(cycle->uplink_start, cycle->uplink_done);
+	report->radio_ms = (cycle->loc_start != 0) ?
+		MAX(report->loc_send_ms, cycle_ms(cycle->loc_start, cycle->uplink_done)) :
+		report->uplink_ms;
+	report->total_ms = cycle_ms(cycle->start, now);
+	report->radio_sessions = cycle->radio_sessions;
+	report->bundled = cycle->loc_sent && cycle->telemetry_bundled;
+	if (cycle->loc_sent) {
+		if (report->bundled) {
+			report->bundled_cycles++;
+			report->bundled_sessions += cycle->radio_sessions;
+		} else {
+			report->separate_cycles++;
+			report->separate_sessions += cycle->radio_sessions;
+		}
+	}
+
+	LOG_INF("Cycle %u: sensing %u ms, loc scan %u ms, loc send %u ms, uplink %u ms, "
+		"radio %u ms, total %u ms, %u radio sessions%s", report->count,
+		report->sensing_ms, report->loc_scan_ms, report->loc_send_ms, report->uplink_ms,
+		report->radio_ms, report->total_ms, report->radio_sessions,
+		report->bundled ? " (bundled)" : "");
+
+	cycle->start = 0;
+}
+
+/*
+ * Tracker lifecycle state machine
+ *
+ * ROOT
+ * +-- INIT          platform and stack bring-up, wait for first READY
+ * +-- RUNNING
+ * |   +-- IDLE      waiting for the next scan cycle
+ * |   +-- SENSING   reading SHT41 / LIS3DH / battery
+ * |   +-- LOCATING  sid_location scan and send in progress
+ * |   `-- UPLINKING telemetry uplink in progress
+ * +-- BLE_L1        BLE link for gateway (L1) location
+ * `-- RESTORING     full stack re-init after a BLE-only L1, wait for READY
+ *
+ * Scan cycles can only start from IDLE, so a new cycle never overlaps an
+ * uplink still in flight. Each state records entry/exit cycle counts.
+ */
+static const struct smf_state at_states[];
+
+static const char *const at_sm_state_names[AT_SM_COUNT] = {
+	[AT_SM_ROOT] = "root",
+	[AT_SM_INIT] = "init",
+	[AT_SM_RUNNING] = "running",
+	[AT_SM_IDLE] = "idle",
+	[AT_SM_SENSING] = "sensing",
+	[AT_SM_LOCATING] = "locating",
+	[AT_SM_UPLINKING] = "uplinking",
+	[AT_SM_BLE_L1] = "ble_l1",
+	[AT_SM_RESTORING] = "restoring",
+};
+
+static void sm_timing_enter(at_ctx_t *at_ctx, enum at_sm_state state)
+{
+	struct at_state_timing *timing = &at_ctx->sm_timing[state];
+
+	timing->entries++;
+	timing->entry_cycles = k_cycle_get_32();
+	at_ctx->sm_state = state;
+	LOG_DBG("Enter state %s", at_sm_state_names[state]);
+}
+
+static void sm_timing_exit(at_ctx_t *at_ctx, enum at_sm_state state)
+{
+	struct at_state_timing *timing = &at_ctx->sm_timing[state];
+
+	timing->exit_cycles = k_cycle_get_32();
+	timing->last_cycles = timing->exit_cycles - timing->entry_cycles;
+	timing->total_cycles += timing->last_cycles;
+	LOG_DBG("Exit state %s after %u ms", at_sm_state_names[state],
+		k_cyc_to_ms_floor32(timing->last_cycles));
+}
+
+/* ROOT - events every state shares */
+static enum smf_state_result sm_root_run(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+	struct at_config prev_conf;
+	sid_error_t err;
+
+	switch (at_ctx->event) {
+	case SIDEWALK_EVENT:
+		at_sid_process(at_ctx);
+		break;
+
+	case BUTTON_EVENT_SHORT:
+		LOG_INF("Uplink in progress. Try again later!");
+		break;
+
+	case MOTION_EVENT:
+		at_scheduler_on_motion();
+		at_ctx->motion = true;
+		break;
+
+	case BUTTON_EVENT_LONG:
+		LOG_INF("Long button press - toggling link type...");
+		at_event_send(EVENT_RADIO_SWITCH);
+		break;
+
+	case EVENT_RADIO_SWITCH:
+		LOG_INF("Switching Sidewalk radio to %s...", 
+			(at_ctx->at_conf.sid_link_type == BLE_LM) ? "BLE" : "LoRa");
+		at_event_send(EVENT_SID_STOP);
+		scan_timer_set_and_run(K_MSEC(2000));
+		break;
+
+	case EVENT_SID_STOP:
+		at_stack_stop(at_ctx);
+		break;
+
+	case EVENT_SID_START:
+		at_stack_start(at_ctx);
+		break;
+
+	case EVENT_CONFIG_UPDATE:
+		prev_conf = at_ctx->at_conf;
+		if (!at_config_apply(&at_ctx->at_conf)) {
+			break;
+		}
+		LOG_INF("Config updated: motion %u s for %u min, static %u min, threshold %u",
+			at_ctx->at_conf.scan_freq_motion, at_ctx->at_conf.motion_period,
+			at_ctx->at_conf.scan_freq_static, at_ctx->at_conf.motion_thres);
+		if (prev_conf.motion_thres != at_ctx->at_conf.motion_thres) {
+			(void)at_lis3dh_motion_config(at_ctx->at_conf.motion_thres);
+		}
+		if (prev_conf.scan_freq_motion != at_ctx->at_conf.scan_freq_motion ||
+		    prev_conf.scan_freq_static != at_ctx->at_conf.scan_freq_static ||
+		    prev_conf.motion_period != at_ctx->at_conf.motion_period) {
+			at_scheduler_reconfigure();
+		}
+		break;
+
+	case EVENT_FACTORY_RESET:
+		/* Factory reset - clears Sidewalk registration and forces re-registration */
+		LOG_INF("Factory reset requested - clearing Sidewalk registration...");
+		
+		if (at_ctx->handle == NULL) {
+			LOG_ERR("Sidewalk not initialized, cannot factory reset");
+			break;
+		}
+		
+		err = sid_set_factory_reset(at_ctx->handle);
+		if (err != SID_ERROR_NONE) {
+			LOG_ERR("sid_set_factory_reset failed: %d", err);
+		} else {
+			LOG_INF("Factory reset initiated successfully");
+			LOG_INF("Device will need to re-register with Sidewalk network");
+		}
+		break;
+
+	default:
+		LOG_DBG("%s ignored in state %s", at_event_name(at_ctx->event),
+			at_sm_state_names[at_ctx->sm_state]);
+		break;
+	}
+
+	return SMF_EVENT_HANDLED;
+}
+
+/* INIT - bring up the platform and the stack, then wait for READY */
+static void sm_init_entry(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	sm_timing_enter(at_ctx, AT_SM_INIT);
 
 	// Pre-configure LR1110 GPIOs as INPUT before SDK registration
 	int gpio_ret = preconfigure_lr1110_gpios();
@@ -225,6 +663,7 @@ static void at_app_entry(void *ctx, void *unused, void *unused2)
 	sid_error_t err = sid_platform_init(&platform_parameters);
 	if (err != SID_ERROR_NONE) {
 		LOG_ERR("Failed to initialize Sidewalk platform: %d", err);
+		smf_set_terminate(SMF_CTX(at_ctx), err);
 		return;
 	}
 
@@ -233,6 +672,7 @@ static void at_app_entry(void *ctx, void *unused, void *unused2)
 		LOG_ERR("Check if the file has been generated and flashed properly");
 		LOG_ERR("START ADDRESS: 0x%08x", APP_MFG_CFG_FLASH_START);
 		LOG_ERR("SIZE: 0x%08x", APP_MFG_CFG_FLASH_SIZE);
+		smf_set_terminate(SMF_CTX(at_ctx), SID_ERROR_GENERIC);
 		return;
 	}
 
@@ -263,6 +703,7 @@ static void at_app_entry(void *ctx, void *unused, void *unused2)
 		break;
 	default:
 		LOG_ERR("Unknown error (%d) during sidewalk initialization!", err);
+		smf_set_terminate(SMF_CTX(at_ctx), err);
 		return;
 	}
 
@@ -281,6 +722,14 @@ static void at_app_entry(void *ctx, void *unused, void *unused2)
 	k_msleep(100);
 	lr11xx_system_get_version(drv_ctx, &version_trx);
 	PRINT_LR_VERSION();
+#ifdef CONFIG_SIDEWALK_SUBGHZ_RADIO_LR1110
+	// Read while the radio is still ours, before sid_start
+	if (lr11xx_gnss_get_almanac_age_for_satellite(drv_ctx, GNSS_BEIDOU_SV_ID,
+						      &beidou_almanac_date) != LR11XX_STATUS_OK) {
+		LOG_WRN("BeiDou almanac date not available");
+		beidou_almanac_date = UINT16_MAX;
+	}
+#endif
 #endif
 
 	LOG_INF("Calling sid_start with default link type...");
@@ -288,6 +737,7 @@ static void at_app_entry(void *ctx, void *unused, void *unused2)
 	LOG_INF("sid_start returned: %d", err);
 	if (err) {
 		LOG_ERR("Unknown error (%d) during sidewalk start!", err);
+		smf_set_terminate(SMF_CTX(at_ctx), err);
 		return;
 	}
 	at_ctx->stack_started = true;
@@ -301,262 +751,686 @@ static void at_app_entry(void *ctx, void *unused, void *unused2)
 	#endif
 
 	at_ctx->sidewalk_state = STATE_SIDEWALK_NOT_READY;
+}
+
+static enum smf_state_result sm_init_run(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	if (at_ctx->event != SIDEWALK_EVENT) {
+		return SMF_EVENT_PROPAGATE;
+	}
+
+	at_sid_process(at_ctx);
+	if (at_ctx->sidewalk_state == STATE_SIDEWALK_READY) {
+		LOG_INF("Device time synchronized to Sidewalk network time. Asset tracker running...");
+		// Start the scan timer - first scan in 5 seconds
+		scan_timer_set_and_run(K_MSEC(5000));
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_IDLE]);
+	}
+	return SMF_EVENT_HANDLED;
+}
+
+static void sm_init_exit(void *o)
+{
+	sm_timing_exit((at_ctx_t *)o, AT_SM_INIT);
+}
+
+/* RUNNING - parent of the scan cycle states */
+static void sm_running_entry(void *o)
+{
+	sm_timing_enter((at_ctx_t *)o, AT_SM_RUNNING);
+}
+
+static enum smf_state_result sm_running_run(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	switch (at_ctx->event) {
+	case EVENT_SID_STOP:
+		// Stopping the stack aborts any cycle in progress
+		at_stack_stop(at_ctx);
+		break;
+
+	case EVENT_CYCLE_TIMEOUT:
+		LOG_WRN("Aborting scan cycle in state %s", at_sm_state_names[at_ctx->sm_state]);
+		break;
+
+	default:
+		return SMF_EVENT_PROPAGATE;
+	}
+
+	if (at_ctx->sm_state != AT_SM_IDLE) {
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_IDLE]);
+	}
+	return SMF_EVENT_HANDLED;
+}
+
+static void sm_running_exit(void *o)
+{
+	sm_timing_exit((at_ctx_t *)o, AT_SM_RUNNING);
+}
+
+/* IDLE - the only state a scan cycle can start from */
+static void sm_idle_entry(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	sm_timing_enter(at_ctx, AT_SM_IDLE);
+	if (at_ctx->cycle.start != 0) {
+		at_cycle_end(at_ctx);
+	}
+}
+
+static enum smf_state_result sm_idle_run(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	switch (at_ctx->event) {
+	case BUTTON_EVENT_SHORT:
+		LOG_INF("Immediate scan and uplink triggered...");
+		scan_timer_set_and_run(K_MSEC(5000));
+		break;
+
+	case EVENT_SCAN_SENSORS:
+		at_cycle_begin(at_ctx);
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_SENSING]);
+		break;
+
+	case EVENT_SCAN_LOC:
+		at_cycle_begin(at_ctx);
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_LOCATING]);
+		break;
+
+	case EVENT_SEND_UPLINK:
+		at_cycle_begin(at_ctx);
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_UPLINKING]);
+		break;
+
+	case EVENT_BLE_LOCATION_START:
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_BLE_L1]);
+		break;
+
+	case EVENT_STORAGE_DRAIN:
+		if (at_ctx->sidewalk_state != STATE_SIDEWALK_READY || at_storage_backlog() == 0) {
+			break;
+		}
+		LOG_INF("Draining %u stored telemetry samples", at_storage_backlog());
+		at_ctx->uplink_drain = true;
+		at_cycle_begin(at_ctx);
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_UPLINKING]);
+		break;
+
+	default:
+		return SMF_EVENT_PROPAGATE;
+	}
+
+	return SMF_EVENT_HANDLED;
+}
+
+static void sm_idle_exit(void *o)
+{
+	sm_timing_exit((at_ctx_t *)o, AT_SM_IDLE);
+}
+
+/* SENSING - sensors are read on the sensor work queue, then location */
+static void sm_sensing_entry(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	sm_timing_enter(at_ctx, AT_SM_SENSING);
+
+	if (at_sensors_request()) {
+		// Go on with the previous snapshot rather than stalling the cycle
+		at_event_send(EVENT_SENSORS_READY);
+	}
+}
+
+static enum smf_state_result sm_sensing_run(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	switch (at_ctx->event) {
+	case EVENT_SENSORS_READY:
+		at_sensors_get(&at_ctx->sensors);
+		at_ctx->cycle.sensors_ready = k_cycle_get_32();
+		if (at_scheduler_accel_update(&at_ctx->sensors)) {
+			at_scheduler_on_motion();
+		}
+		at_ctx->motion = at_scheduler_in_motion();
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_LOCATING]);
+		break;
+
+	case EVENT_SCAN_LOC:
+		// Location starts once the snapshot is in, see EVENT_SENSORS_READY
+		break;
+
+	default:
+		return SMF_EVENT_PROPAGATE;
+	}
+
+	return SMF_EVENT_HANDLED;
+}
+
+static void sm_sensing_exit(void *o)
+{
+	sm_timing_exit((at_ctx_t *)o, AT_SM_SENSING);
+}
+
+/* LOCATING - location scan; telemetry is queued as soon as the scan is done */
+static void sm_locating_entry(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	sm_timing_enter(at_ctx, AT_SM_LOCATING);
+
+	at_ctx->cycle.loc_pending = true;
+	at_ctx->cycle.loc_start = k_cycle_get_32();
+	LOG_INF("Triggering location scan via SDK...");
+	trigger_location_scan(at_ctx);
+}
+
+static enum smf_state_result sm_locating_run(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	switch (at_ctx->event) {
+	case EVENT_LOCATION_SCANNED:
+		// Location fragments are still in flight, overlap the telemetry uplink
+		at_ctx->cycle.loc_scan_done = k_cycle_get_32();
+		if (loc_scan_only && !send_location_scan(at_ctx)) {
+			at_ctx->cycle.loc_pending = false;
+			at_ctx->cycle.loc_done = at_ctx->cycle.loc_scan_done;
+		}
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_UPLINKING]);
+		break;
+
+	case EVENT_LOCATION_DONE:
+		at_ctx->cycle.loc_pending = false;
+		at_ctx->cycle.loc_done = k_cycle_get_32();
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_UPLINKING]);
+		break;
+
+	case EVENT_SCAN_LOC:
+		LOG_DBG("Location scan already in progress");
+		break;
+
+	default:
+		return SMF_EVENT_PROPAGATE;
+	}
+
+	return SMF_EVENT_HANDLED;
+}
+
+static void sm_locating_exit(void *o)
+{
+	sm_timing_exit((at_ctx_t *)o, AT_SM_LOCATING);
+}
+
+/*
+ * UPLINKING - telemetry uplink, including the BLE connection wait. The cycle
+ * ends once both the telemetry and any location send still in flight are done.
+ */
+static void sm_uplinking_entry(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	sm_timing_enter(at_ctx, AT_SM_UPLINKING);
+
+	at_ctx->cycle.uplink_pending = true;
+	at_ctx->cycle.uplink_start = k_cycle_get_32();
+	at_uplink_telemetry(at_ctx);
+}
+
+static enum smf_state_result sm_uplinking_run(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+	sid_error_t err;
+
+	switch (at_ctx->event) {
+	case EVENT_BLE_CONNECTION_REQUEST:
+		LOG_INF("Requesting BLE connection...");
+		err = sid_ble_bcn_connection_request(at_ctx->handle, true);
+		if (err != SID_ERROR_NONE) {
+			LOG_ERR("Error setting BLE connection request");
+		}
+		at_ctx->ble_conn_waiting = true;
+		at_ctx->ble_wait.attempts++;
+		at_ctx->ble_wait.wakeups = 0;
+		ble_conn_timer_set_and_run();
+		// Check once now in case the link is already up, then block until
+		// on_sidewalk_status_changed() or the connection timer signals us
+		at_event_send(EVENT_BLE_CONNECTION_WAIT);
+		break;
+
+	case EVENT_BLE_CONNECTION_WAIT:
+		if (!at_ctx->ble_conn_waiting) {
+			LOG_DBG("Stale BLE connection wait signal ignored");
+			break;
+		}
+		at_ctx->ble_wait.wakeups++;
+		if (at_ctx->sidewalk_state == STATE_SIDEWALK_READY && 
+		    (at_ctx->link_status.link_status_mask & BLE_LM) != 0) {
+			ble_conn_wait_finish(at_ctx);
+			at_event_send(EVENT_SEND_UPLINK);
+		} else if (ble_timeout == true) {
+			at_ctx->ble_wait.timeouts++;
+			ble_conn_wait_finish(at_ctx);
+			at_event_send(EVENT_SID_STOP);
+		}
+		break;
+
+	case EVENT_SEND_UPLINK:
+	case EVENT_UPLINK_RETRY:
+		at_uplink_start(at_ctx);
+		break;
+
+	case EVENT_UPLINK_COMPLETE:
+		LOG_INF("Uplink complete.");
+		at_ctx->cycle.uplink_pending = false;
+		at_ctx->cycle.uplink_done = k_cycle_get_32();
+		if (at_ctx->cycle.loc_pending) {
+			LOG_DBG("Waiting for location send to finish");
+			break;
+		}
+		// Stack stays running - no longer stopping after each uplink
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_IDLE]);
+		break;
+
+	case EVENT_LOCATION_DONE:
+		at_ctx->cycle.loc_pending = false;
+		at_ctx->cycle.loc_done = k_cycle_get_32();
+		if (!at_ctx->cycle.uplink_pending) {
+			smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_IDLE]);
+		}
+		break;
+
+	default:
+		return SMF_EVENT_PROPAGATE;
+	}
+
+	return SMF_EVENT_HANDLED;
+}
+
+static void sm_uplinking_exit(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	if (at_ctx->ble_conn_waiting) {
+		ble_conn_wait_finish(at_ctx);
+	}
+	if (at_ctx->cycle.uplink_pending) {
+		// Cycle aborted before the uplink finished, keep the telemetry
+		at_uplink_abort(at_ctx);
+	}
+	// A bundled location result is settled with its uplink
+	int bundle_err = at_uplink_bundle_result();
+
+	if (bundle_err != -ENOENT && bundle_err != -EINPROGRESS) {
+		at_loc_policy_outcome(bundle_err == 0 ? AT_LOC_SENT : AT_LOC_FAILED, loc_scan_mode);
+	}
+	at_ctx->uplink_drain = false;
+	sm_timing_exit(at_ctx, AT_SM_UPLINKING);
+}
+
+/* BLE_L1 - BLE link for an L1 (gateway) location ping */
+static enum ble_l1_path ble_l1_path;
+static bool ble_l1_ready;
+static bool ble_l1_link_started;	// BLE was started for the ping, stop it after
+static uint32_t ble_l1_start;
+static uint32_t ble_l1_restore_start;
+
+static void ble_l1_reinit(at_ctx_t *at_ctx)
+{
+	sid_error_t err;
+
+	/* Switch to BLE-only mode for L1 location */
+	LOG_INF("Switching to BLE-only mode for L1 location...");
+	
+	/* Stop current stack */
+	if (at_ctx->stack_started) {
+		sid_location_deinit(at_ctx->handle);
+		err = sid_stop(at_ctx->handle, at_ctx->sidewalk_config.link_mask);
+		LOG_INF("sid_stop returned %d", err);
+		at_ctx->stack_started = false;
+	}
+	
+	/* Deinit and reinit with BLE-only */
+	sid_deinit(at_ctx->handle);
+	at_ctx->handle = NULL;
+	at_ctx->sidewalk_state = STATE_SIDEWALK_NOT_READY;
 	
-	while (true) {
-		at_event_t event = SIDEWALK_EVENT;
-
-		if (!k_msgq_get(&at_thread_msgq, &event, K_FOREVER)) {
-			switch (event) {
-			case SIDEWALK_EVENT:
-				err = sid_process(at_ctx->handle);
-				if (err) {
-					LOG_DBG("sid_process returned %d", err);
-				}
-				break;
-			
-			case BUTTON_EVENT_SHORT:
-				if (at_ctx->total_msg == 0) {
-					LOG_INF("Immediate scan and uplink triggered...");
-					scan_timer_set_and_run(K_MSEC(5000));
-				} else {
-					LOG_INF("Uplink in progress. Try again later!");
-				}
-				break;
-			
-			case BUTTON_EVENT_LONG:
-				LOG_INF("Long button press - toggling link type...");
-				at_event_send(EVENT_RADIO_SWITCH);
-				break;
-
-			case EVENT_RADIO_SWITCH:
-				LOG_INF("Switching Sidewalk radio to %s...", 
-					(at_ctx->at_conf.sid_link_type == BLE_LM) ? "BLE" : "LoRa");
-				at_event_send(EVENT_SID_STOP);
-				scan_timer_set_and_run(K_MSEC(2000));
-				break;
-
-			case EVENT_BLE_CONNECTION_REQUEST:
-				LOG_INF("Requesting BLE connection...");
-				err = sid_ble_bcn_connection_request(at_ctx->handle, true);
-				if (err != SID_ERROR_NONE) {
-					LOG_ERR("Error setting BLE connection request");
-				}
-				ble_conn_timer_set_and_run();
-				at_event_send(EVENT_BLE_CONNECTION_WAIT);
-				break;
-
-			case EVENT_BLE_CONNECTION_WAIT:
-				if (at_ctx->sidewalk_state == STATE_SIDEWALK_READY && 
-				    (at_ctx->link_status.link_status_mask & BLE_LM) != 0) {
-					at_event_send(EVENT_SEND_UPLINK);
-					ble_conn_timer_stop();
-				} else {
-					if (ble_timeout == true) {
-						ble_conn_timer_stop();
-						at_event_send(EVENT_SID_STOP);
-					} else {
-						at_event_send(EVENT_BLE_CONNECTION_WAIT);
-						k_msleep(20);
-					}
-				}
-				break;
-
-			case EVENT_SEND_UPLINK:
-				// For BLE, we need to request connection first if link is down
-				if (at_ctx->at_conf.sid_link_type == BLE_LM) {
-					if (at_ctx->sidewalk_state != STATE_SIDEWALK_READY || 
-					    (at_ctx->link_status.link_status_mask & BLE_LM) == 0) {
-						at_event_send(EVENT_BLE_CONNECTION_REQUEST);
-						break;
-					}
-				}
-				// For LoRa, just need time sync - it's connectionless/fire-and-forget
-				// No need to check link_status_mask for LoRa
-				LOG_INF("Sending uplink...");
-				at_send_uplink(at_ctx);
-				break;
-
-			case EVENT_UPLINK_COMPLETE:
-				LOG_INF("Uplink complete.");
-				// Stack stays running - no longer stopping after each uplink
-				break;
-
-			case EVENT_SCAN_SENSORS:
-				LOG_INF("Scanning sensors...");
-				get_temp_hum(&at_ctx->sensors);
-				get_accel(&at_ctx->sensors);
-				get_batt(&at_ctx->sensors);
-				break;
-
-			case EVENT_SCAN_LOC:
-				LOG_INF("Triggering location scan via SDK...");
-				trigger_location_scan(at_ctx);
-				break;
-
-			case EVENT_SID_STOP:
-				LOG_INF("Going to sleep...");
-				if (at_ctx->stack_started) {
-					err = sid_process(at_ctx->handle);
-					if (err) {
-						LOG_DBG("sid_process returned %d", err);
-					}
-					LOG_INF("Calling sid_stop with link_type 0x%x", 
-						at_ctx->at_conf.sid_link_type);
-					err = sid_stop(at_ctx->handle, at_ctx->at_conf.sid_link_type);
-					LOG_INF("sid_stop returned %d", err);
-					at_ctx->stack_started = false;
-				} else {
-					LOG_DBG("Stack not running, skipping sid_stop");
-				}
-				k_msgq_purge(&at_thread_msgq);
-				break;
-
-			case EVENT_SID_START:
-				LOG_INF("EVENT_SID_START: stack_started=%d", at_ctx->stack_started);
-				if (at_ctx->stack_started) {
-					LOG_DBG("Sidewalk stack already started, skipping sid_start");
-				} else {
-					LOG_INF("Starting Sidewalk stack with link_type 0x%x...", 
-						at_ctx->at_conf.sid_link_type);
-					err = sid_start(at_ctx->handle, at_ctx->at_conf.sid_link_type);
-					if (err) {
-						LOG_ERR("sid_start returned %d", err);
-					} else {
-						at_ctx->stack_started = true;
-						LOG_INF("stack_started set to true");
-						// Re-initialize location services after stack restart
-						sid_location_deinit(at_ctx->handle);
-						init_location_services(at_ctx);
-					}
-				}
-				break;
-
-			case EVENT_BLE_LOCATION_START:
-				/* Switch to BLE-only mode for L1 location */
-				LOG_INF("Switching to BLE-only mode for L1 location...");
-				
-				/* Set pending flag - will trigger location when BLE is ready */
-				at_ctx->ble_location_pending = true;
-				
-				/* Stop current stack */
-				if (at_ctx->stack_started) {
-					sid_location_deinit(at_ctx->handle);
-					err = sid_stop(at_ctx->handle, at_ctx->sidewalk_config.link_mask);
-					LOG_INF("sid_stop returned %d", err);
-					at_ctx->stack_started = false;
-				}
-				
-				/* Deinit and reinit with BLE-only */
-				sid_deinit(at_ctx->handle);
-				at_ctx->handle = NULL;
-				
-				/* Reinit with BLE-only config */
-				struct sid_config ble_only_config = at_ctx->sidewalk_config;
-				ble_only_config.link_mask = BLE_LM;
-				ble_only_config.sub_ghz_link_config = NULL;
-				
-				err = sid_init(&ble_only_config, &at_ctx->handle);
-				if (err != SID_ERROR_NONE) {
-					LOG_ERR("sid_init (BLE-only) failed: %d", err);
-					at_ctx->ble_location_pending = false;
-					at_event_send(EVENT_RESTORE_FULL_STACK);
-					break;
-				}
-				
-				err = sid_start(at_ctx->handle, BLE_LM);
-				if (err != SID_ERROR_NONE) {
-					LOG_ERR("sid_start (BLE-only) failed: %d", err);
-					at_ctx->ble_location_pending = false;
-					at_event_send(EVENT_RESTORE_FULL_STACK);
-					break;
-				}
-				at_ctx->stack_started = true;
-				LOG_INF("BLE-only stack started, requesting connection...");
-				
-				/* Request BLE connection - location will trigger when ready */
-				err = sid_ble_bcn_connection_request(at_ctx->handle, true);
-				if (err != SID_ERROR_NONE) {
-					LOG_ERR("Error setting BLE connection request: %d", err);
-				}
-				break;
-
-			case EVENT_BLE_LOCATION_READY:
-				/* BLE stack is ready, now trigger L1 location */
-				LOG_INF("BLE ready, initializing and running L1 location...");
-				at_ctx->ble_location_pending = false;
-				
-				/* Trigger the BLE location from location_shell */
-				location_shell_trigger_ble_location();
-				break;
-
-			case EVENT_RESTORE_FULL_STACK:
-				/* Restore full stack after BLE location */
-				LOG_INF("Restoring full stack (BLE + LoRa)...");
-				
-				/* Stop and deinit current stack */
-				if (at_ctx->stack_started) {
-					sid_location_deinit(at_ctx->handle);
-					sid_stop(at_ctx->handle, BLE_LM);
-					at_ctx->stack_started = false;
-				}
-				if (at_ctx->handle) {
-					sid_deinit(at_ctx->handle);
-					at_ctx->handle = NULL;
-				}
-				
-				/* Reinit with full config */
-				err = sid_init(&at_ctx->sidewalk_config, &at_ctx->handle);
-				if (err != SID_ERROR_NONE) {
-					LOG_ERR("sid_init (full) failed: %d", err);
-					break;
-				}
-				
-				/* Start with configured link type */
-				err = sid_start(at_ctx->handle, at_ctx->at_conf.sid_link_type);
-				if (err != SID_ERROR_NONE) {
-					LOG_ERR("sid_start (full) failed: %d", err);
-					break;
-				}
-				at_ctx->stack_started = true;
-				
-				/* Reinit location services with full config */
-				init_location_services(at_ctx);
-				
-				LOG_INF("Full stack restored, link_type=0x%x", at_ctx->at_conf.sid_link_type);
-				break;
-
-			case EVENT_FACTORY_RESET:
-				/* Factory reset - clears Sidewalk registration and forces re-registration */
-				LOG_INF("Factory reset requested - clearing Sidewalk registration...");
-				
-				if (at_ctx->handle == NULL) {
-					LOG_ERR("Sidewalk not initialized, cannot factory reset");
-					break;
-				}
-				
-				err = sid_set_factory_reset(at_ctx->handle);
-				if (err != SID_ERROR_NONE) {
-					LOG_ERR("sid_set_factory_reset failed: %d", err);
-				} else {
-					LOG_INF("Factory reset initiated successfully");
-					LOG_INF("Device will need to re-register with Sidewalk network");
-				}
-				break;
-
-			default:
-				LOG_ERR("Invalid Event received: %d", event);
-			}
+	/* Reinit with BLE-only config */
+	struct sid_config ble_only_config = at_ctx->sidewalk_config;
+	ble_only_config.link_mask = BLE_LM;
+	ble_only_config.sub_ghz_link_config = NULL;
+	
+	err = sid_init(&ble_only_config, &at_ctx->handle);
+	if (err != SID_ERROR_NONE) {
+		LOG_ERR("sid_init (BLE-only) failed: %d", err);
+		at_event_send(EVENT_RESTORE_FULL_STACK);
+		return;
+	}
+	
+	err = sid_start(at_ctx->handle, BLE_LM);
+	if (err != SID_ERROR_NONE) {
+		LOG_ERR("sid_start (BLE-only) failed: %d", err);
+		at_event_send(EVENT_RESTORE_FULL_STACK);
+		return;
+	}
+	at_ctx->stack_started = true;
+	LOG_INF("BLE-only stack started, requesting connection...");
+	
+	/* Request BLE connection - location will trigger when ready */
+	err = sid_ble_bcn_connection_request(at_ctx->handle, true);
+	if (err != SID_ERROR_NONE) {
+		LOG_ERR("Error setting BLE connection request: %d", err);
+	}
+}
+
+/*
+ * The stack is initialized with BLE and LoRa, so BLE can be started next to
+ * the running link and stopped again without a re-init
+ */
+static void ble_l1_link_switch(at_ctx_t *at_ctx)
+{
+	sid_error_t err;
+
+	if ((at_ctx->at_conf.sid_link_type & BLE_LM) == 0) {
+		LOG_INF("Starting BLE next to link_type 0x%x for L1 location...",
+			at_ctx->at_conf.sid_link_type);
+		err = sid_start(at_ctx->handle, BLE_LM);
+		if (err != SID_ERROR_NONE) {
+			LOG_ERR("sid_start (BLE) failed: %d", err);
+			at_event_send(EVENT_RESTORE_FULL_STACK);
+			return;
 		}
+		ble_l1_link_started = true;
+	}
+
+	err = sid_ble_bcn_connection_request(at_ctx->handle, true);
+	if (err != SID_ERROR_NONE) {
+		LOG_ERR("Error setting BLE connection request: %d", err);
+	}
+	if (at_ctx->sidewalk_state == STATE_SIDEWALK_READY &&
+	    (at_ctx->link_status.link_status_mask & BLE_LM) != 0) {
+		at_event_send(EVENT_BLE_LOCATION_READY);
 	}
 }
 
-void at_event_send(at_event_t event)
+static void ble_l1_link_restore(at_ctx_t *at_ctx)
 {
-	int ret = k_msgq_put(&at_thread_msgq, (void *)&event,
-			     k_is_in_isr() ? K_NO_WAIT : K_FOREVER);
+	if (!ble_l1_link_started) {
+		return;
+	}
+	sid_error_t err = sid_stop(at_ctx->handle, BLE_LM);
+	LOG_INF("sid_stop (BLE) returned %d, link_type 0x%x stays up", err,
+		at_ctx->at_conf.sid_link_type);
+	ble_l1_link_started = false;
+}
+
+static void ble_l1_restored(at_ctx_t *at_ctx)
+{
+	struct ble_l1_timing *timing = &at_ctx->ble_l1[ble_l1_path];
+
+	// A BLE start that failed comes back here too, keep it out of the timing
+	if (!ble_l1_ready) {
+		timing->failures++;
+		LOG_WRN("BLE L1 %s failed, BLE link never came up",
+			(ble_l1_path == BLE_L1_PATH_LINK_SWITCH) ? "link switch" : "re-init");
+		return;
+	}
+
+	timing->restores++;
+	timing->last_restore_ms = cycle_ms(ble_l1_restore_start, k_cycle_get_32());
+	timing->total_restore_ms += timing->last_restore_ms;
+	LOG_INF("BLE L1 %s: switch %u ms, restore %u ms",
+		(ble_l1_path == BLE_L1_PATH_LINK_SWITCH) ? "link switch" : "re-init",
+		timing->last_switch_ms, timing->last_restore_ms);
+}
+
+static void sm_ble_l1_entry(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	sm_timing_enter(at_ctx, AT_SM_BLE_L1);
+	// No gateway in range must not keep the tracker here
+	ble_l1_timer_set_and_run(K_SECONDS(CONFIG_BLE_L1_TIMEOUT_S));
+
+	ble_l1_start = k_cycle_get_32();
+	ble_l1_ready = false;
+	ble_l1_link_started = false;
+	// A stopped stack has nothing to run next to
+	ble_l1_path = (IS_ENABLED(CONFIG_BLE_L1_LINK_SWITCH) && at_ctx->stack_started) ?
+			      BLE_L1_PATH_LINK_SWITCH : BLE_L1_PATH_REINIT;
+	if (ble_l1_path == BLE_L1_PATH_LINK_SWITCH) {
+		ble_l1_link_switch(at_ctx);
+	} else {
+		ble_l1_reinit(at_ctx);
+	}
+}
+
+static enum smf_state_result sm_ble_l1_run(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+	struct ble_l1_timing *timing = &at_ctx->ble_l1[ble_l1_path];
+
+	switch (at_ctx->event) {
+	case EVENT_BLE_LOCATION_READY:
+		if (ble_l1_ready) {
+			LOG_DBG("L1 location already triggered");
+			break;
+		}
+		ble_l1_ready = true;
+		timing->switches++;
+		timing->last_switch_ms = cycle_ms(ble_l1_start, k_cycle_get_32());
+		timing->total_switch_ms += timing->last_switch_ms;
+
+		/* BLE stack is ready, now trigger L1 location */
+		LOG_INF("BLE ready after %u ms, running L1 location...", timing->last_switch_ms);
+		
+		/* Trigger the BLE location from location_shell */
+		location_shell_trigger_ble_location();
+		break;
+
+	case EVENT_RESTORE_FULL_STACK:
+		ble_l1_restore_start = k_cycle_get_32();
+		if (ble_l1_path == BLE_L1_PATH_REINIT) {
+			smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_RESTORING]);
+			break;
+		}
+		ble_l1_link_restore(at_ctx);
+		ble_l1_restored(at_ctx);
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_IDLE]);
+		break;
+
+	case EVENT_BLE_L1_TIMEOUT:
+		if (!ble_l1_timer_expired()) {
+			break;
+		}
+		at_ctx->ble_l1[ble_l1_path].timeouts++;
+		LOG_WRN("BLE L1 %s gave up after %u s, %s", (ble_l1_path == BLE_L1_PATH_LINK_SWITCH) ?
+			"link switch" : "re-init", CONFIG_BLE_L1_TIMEOUT_S,
+			ble_l1_ready ? "ping not done" : "BLE link never came up");
+		at_event_send(EVENT_RESTORE_FULL_STACK);
+		break;
+
+	default:
+		return SMF_EVENT_PROPAGATE;
+	}
+
+	return SMF_EVENT_HANDLED;
+}
+
+static void sm_ble_l1_exit(void *o)
+{
+	ble_l1_timer_stop();
+	sm_timing_exit((at_ctx_t *)o, AT_SM_BLE_L1);
+}
+
+/*
+ * RESTORING - full stack re-init after BLE_L1, wait for READY. A failed
+ * init is retried every CONFIG_RESTORE_RETRY_S, and after
+ * CONFIG_RESTORE_TIMEOUT_S the stack is stopped and the tracker goes idle.
+ */
+static bool at_restore_full_stack(at_ctx_t *at_ctx)
+{
+	sid_error_t err;
+
+	/* Restore full stack after BLE location */
+	LOG_INF("Restoring full stack (BLE + LoRa)...");
+	
+	/* Stop and deinit current stack */
+	if (at_ctx->stack_started) {
+		sid_location_deinit(at_ctx->handle);
+		sid_stop(at_ctx->handle, BLE_LM);
+		at_ctx->stack_started = false;
+	}
+	if (at_ctx->handle) {
+		sid_deinit(at_ctx->handle);
+		at_ctx->handle = NULL;
+	}
+	at_ctx->sidewalk_state = STATE_SIDEWALK_NOT_READY;
+	
+	/* Reinit with full config */
+	err = sid_init(&at_ctx->sidewalk_config, &at_ctx->handle);
+	if (err != SID_ERROR_NONE) {
+		LOG_ERR("sid_init (full) failed: %d", err);
+		at_ctx->handle = NULL;
+		return false;
+	}
+	
+	/* Start with configured link type */
+	err = sid_start(at_ctx->handle, at_ctx->at_conf.sid_link_type);
+	if (err != SID_ERROR_NONE) {
+		LOG_ERR("sid_start (full) failed: %d", err);
+		return false;
+	}
+	at_ctx->stack_started = true;
+	
+	/* Reinit location services with full config */
+	init_location_services(at_ctx);
+	
+	LOG_INF("Full stack restored, link_type=0x%x", at_ctx->at_conf.sid_link_type);
+	return true;
+}
 
-	if (ret) {
-		LOG_ERR("Failed to send event to asset tracker thread. err: %d", ret);
+static void sm_restoring_entry(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	sm_timing_enter(at_ctx, AT_SM_RESTORING);
+	ble_l1_timer_set_and_run(K_SECONDS(CONFIG_RESTORE_TIMEOUT_S));
+	if (!at_restore_full_stack(at_ctx)) {
+		restore_retry_timer_set_and_run();
+	}
+}
+
+static enum smf_state_result sm_restoring_run(void *o)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)o;
+
+	switch (at_ctx->event) {
+	case SIDEWALK_EVENT:
+		at_sid_process(at_ctx);
+		if (at_ctx->stack_started && at_ctx->sidewalk_state == STATE_SIDEWALK_READY) {
+			ble_l1_restored(at_ctx);
+			smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_IDLE]);
+		}
+		break;
+
+	case EVENT_RESTORE_FULL_STACK:
+		// Retry after a failed restore
+		if (!at_ctx->stack_started && !at_restore_full_stack(at_ctx)) {
+			restore_retry_timer_set_and_run();
+		}
+		break;
+
+	case EVENT_BLE_L1_TIMEOUT:
+		if (!ble_l1_timer_expired()) {
+			break;
+		}
+		LOG_ERR("Stack not ready %u s after restore, stopping it until the next cycle",
+			CONFIG_RESTORE_TIMEOUT_S);
+		// ble_l1_restored is never reached from here
+		at_ctx->ble_l1[ble_l1_path].timeouts++;
+		if (!ble_l1_ready) {
+			at_ctx->ble_l1[ble_l1_path].failures++;
+		}
+		if (at_ctx->stack_started) {
+			sid_error_t err = sid_stop(at_ctx->handle, at_ctx->at_conf.sid_link_type);
+
+			LOG_INF("sid_stop returned %d", err);
+			at_ctx->stack_started = false;
+		}
+		smf_set_state(SMF_CTX(at_ctx), &at_states[AT_SM_IDLE]);
+		break;
+
+	default:
+		return SMF_EVENT_PROPAGATE;
+	}
+
+	return SMF_EVENT_HANDLED;
+}
+
+static void sm_restoring_exit(void *o)
+{
+	ble_l1_timer_stop();
+	restore_retry_timer_stop();
+	sm_timing_exit((at_ctx_t *)o, AT_SM_RESTORING);
+}
+
+static const struct smf_state at_states[] = {
+	[AT_SM_ROOT] = SMF_CREATE_STATE(NULL, sm_root_run, NULL, NULL, NULL),
+	[AT_SM_INIT] = SMF_CREATE_STATE(sm_init_entry, sm_init_run, sm_init_exit,
+					&at_states[AT_SM_ROOT], NULL),
+	[AT_SM_RUNNING] = SMF_CREATE_STATE(sm_running_entry, sm_running_run, sm_running_exit,
+					   &at_states[AT_SM_ROOT], &at_states[AT_SM_IDLE]),
+	[AT_SM_IDLE] = SMF_CREATE_STATE(sm_idle_entry, sm_idle_run, sm_idle_exit,
+					&at_states[AT_SM_RUNNING], NULL),
+	[AT_SM_SENSING] = SMF_CREATE_STATE(sm_sensing_entry, sm_sensing_run, sm_sensing_exit,
+					   &at_states[AT_SM_RUNNING], NULL),
+	[AT_SM_LOCATING] = SMF_CREATE_STATE(sm_locating_entry, sm_locating_run, sm_locating_exit,
+					    &at_states[AT_SM_RUNNING], NULL),
+	[AT_SM_UPLINKING] = SMF_CREATE_STATE(sm_uplinking_entry, sm_uplinking_run,
+					     sm_uplinking_exit, &at_states[AT_SM_RUNNING], NULL),
+	[AT_SM_BLE_L1] = SMF_CREATE_STATE(sm_ble_l1_entry, sm_ble_l1_run, sm_ble_l1_exit,
+					  &at_states[AT_SM_ROOT], NULL),
+	[AT_SM_RESTORING] = SMF_CREATE_STATE(sm_restoring_entry, sm_restoring_run,
+					     sm_restoring_exit, &at_states[AT_SM_ROOT], NULL),
+};
+
+const char *at_sm_state_name(enum at_sm_state state)
+{
+	return (state < AT_SM_COUNT) ? at_sm_state_names[state] : "unknown";
+}
+
+static void at_app_entry(void *ctx, void *unused, void *unused2)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)ctx;
+	ARG_UNUSED(unused);
+	ARG_UNUSED(unused2);
+	LOG_DBG("Starting %s ...", __FUNCTION__);
+	
+	PRINT_AWSIOT_LOGO();
+	PRINT_AT_VERSION();
+
+	smf_set_initial(SMF_CTX(at_ctx), &at_states[AT_SM_INIT]);
+	if (at_ctx->smf.terminate_val) {
+		LOG_ERR("Asset tracker init failed: %d", at_ctx->smf.terminate_val);
+		return;
+	}
+
+	while (true) {
+		if (at_event_get(&at_ctx->event, K_FOREVER)) {
+			continue;
+		}
+
+		int32_t ret = smf_run_state(SMF_CTX(at_ctx));
+		if (ret) {
+			LOG_ERR("Asset tracker state machine terminated: %d", ret);
+			return;
+		}
 	}
 }
 
@@ -597,7 +1471,16 @@ sid_error_t at_thread_init(void)
 		.scan_freq_motion = CONFIG_MOTION_SCAN_PER_S,
 		.motion_thres = 5,
 		.scan_freq_static = CONFIG_STATIC_SCAN_PER_M,
+		.batch_size = CONFIG_TELEMETRY_BATCH_SIZE,
+		.uplink_ack = IS_ENABLED(CONFIG_UPLINK_ACK),
+		.uplink_retries = CONFIG_UPLINK_RETRIES,
 	};
+	// Runtime changes saved by a previous boot win over the Kconfig defaults
+	(void)at_config_load(&asset_tracker_context.at_conf);
+
+	if (at_lis3dh_motion_config(asset_tracker_context.at_conf.motion_thres)) {
+		LOG_WRN("No activity interrupt, motion detected by polling only");
+	}
 
 	asset_tracker_context.sidewalk_config = (struct sid_config) {
 		.link_mask = (BLE_LM | LORA_LM),  // Init with all supported links, start with default
@@ -615,6 +1498,8 @@ sid_error_t at_thread_init(void)
 
 	asset_tracker_context.sidewalk_state = STATE_SIDEWALK_INIT;
 
+	at_scheduler_init(&asset_tracker_context.at_conf);
+
 	if (sidewalk_callbacks_set(&asset_tracker_context, &asset_tracker_context.event_callbacks)) {
 		LOG_ERR("Failed to set sidewalk callbacks");
 		SID_PAL_ASSERT(false);
@@ -624,6 +1509,8 @@ sid_error_t at_thread_init(void)
 	AT_CLI_init(&asset_tracker_context);
 	#endif
 
+	at_downlink_init(&asset_tracker_context);
+
 	// Register GATT authorization callbacks before starting BLE
 	int err = bt_gatt_authorization_cb_register(&gatt_authorization_callbacks);
 	if (err) {
@@ -0,0 +1,263 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#include <errno.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <asset_tracker.h>
+#include "at_config.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(at_config, CONFIG_TRACKER_LOG_LEVEL);
+
+#define AT_CONFIG_SUBTREE "tracker"
+#define AT_CONFIG_KEY "conf"
+
+/*
+ * Saved record, little endian with no padding so it does not depend on the
+ * compiler's struct layout:
+ * version, max_rec (2), sid_link_type (4), motion_period, scan_freq_motion,
+ * motion_thres, scan_freq_static, batch_size, uplink_ack, uplink_retries
+ * Bump the version when the record changes.
+ */
+#define AT_CONFIG_VERSION 2
+#define AT_CONFIG_RECORD_SIZE 14
+
+static struct k_spinlock conf_lock;
+static struct at_config staged;
+static bool staged_pending;
+
+static struct at_config loaded;
+static bool loaded_valid;
+
+/* Latest applied config and what flash holds, both under conf_lock */
+static struct at_config pending;
+static struct at_config persisted;
+static bool persisted_valid;
+static struct at_config_stats conf_stats;
+
+static void save_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(save_work, save_work_handler);
+
+static void conf_encode(const struct at_config *conf, uint8_t *record)
+{
+	record[0] = AT_CONFIG_VERSION;
+	sys_put_le16(conf->max_rec, &record[1]);
+	sys_put_le32(conf->sid_link_type, &record[3]);
+	record[7] = conf->motion_period;
+	record[8] = conf->scan_freq_motion;
+	record[9] = conf->motion_thres;
+	record[10] = conf->scan_freq_static;
+	record[11] = conf->batch_size;
+	record[12] = conf->uplink_ack;
+	record[13] = conf->uplink_retries;
+}
+
+static void conf_decode(const uint8_t *record, struct at_config *conf)
+{
+	conf->max_rec = sys_get_le16(&record[1]);
+	conf->sid_link_type = sys_get_le32(&record[3]);
+	conf->motion_period = record[7];
+	conf->scan_freq_motion = record[8];
+	conf->motion_thres = record[9];
+	conf->scan_freq_static = record[10];
+	conf->batch_size = record[11];
+	conf->uplink_ack = record[12];
+	conf->uplink_retries = record[13];
+}
+
+static bool conf_equal(const struct at_config *a, const struct at_config *b)
+{
+	return a->max_rec == b->max_rec && a->sid_link_type == b->sid_link_type &&
+	       a->motion_period == b->motion_period &&
+	       a->scan_freq_motion == b->scan_freq_motion &&
+	       a->motion_thres == b->motion_thres &&
+	       a->scan_freq_static == b->scan_freq_static &&
+	       a->batch_size == b->batch_size && a->uplink_ack == b->uplink_ack &&
+	       a->uplink_retries == b->uplink_retries;
+}
+
+static int conf_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	uint8_t record[AT_CONFIG_RECORD_SIZE];
+	const char *next;
+
+	if (!settings_name_steq(name, AT_CONFIG_KEY, &next) || next) {
+		return -ENOENT;
+	}
+
+	if (len != sizeof(record)) {
+		LOG_WRN("Saved config has size %u, expected %u, ignoring", (uint32_t)len,
+			(uint32_t)sizeof(record));
+		return 0;
+	}
+
+	if (read_cb(cb_arg, record, sizeof(record)) != sizeof(record)) {
+		return -EIO;
+	}
+	loaded_valid = (record[0] == AT_CONFIG_VERSION);
+	if (loaded_valid) {
+		conf_decode(record, &loaded);
+	}
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(at_config, AT_CONFIG_SUBTREE, NULL, conf_set, NULL, NULL);
+
+int at_config_validate(const struct at_config *conf)
+{
+	if (conf->sid_link_type != BLE_LM && conf->sid_link_type != LORA_LM &&
+	    conf->sid_link_type != (BLE_LM | LORA_LM)) {
+		return -EINVAL;
+	}
+	if (conf->motion_period < AT_CONF_MOTION_PERIOD_MIN_M ||
+	    conf->scan_freq_motion < AT_CONF_SCAN_MOTION_MIN_S ||
+	    conf->scan_freq_static < AT_CONF_SCAN_STATIC_MIN_M) {
+		return -EINVAL;
+	}
+	if (conf->motion_thres < AT_CONF_MOTION_THRES_MIN ||
+	    conf->motion_thres > AT_CONF_MOTION_THRES_MAX) {
+		return -EINVAL;
+	}
+	if (conf->batch_size < 1 || conf->batch_size > TELEMETRY_BATCH_MAX ||
+	    conf->uplink_ack > 1 || conf->uplink_retries > AT_CONF_RETRIES_MAX) {
+		return -EINVAL;
+	}
+	return 0;
+}
+
+int at_config_load(struct at_config *conf)
+{
+	int err = settings_subsys_init();
+
+	if (err) {
+		LOG_ERR("Settings init failed: %d", err);
+		return err;
+	}
+
+	err = settings_load_subtree(AT_CONFIG_SUBTREE);
+	if (err) {
+		LOG_ERR("Loading saved config failed: %d", err);
+		return err;
+	}
+
+	if (!loaded_valid || at_config_validate(&loaded)) {
+		LOG_INF("No saved config, using defaults");
+		return -ENOENT;
+	}
+
+	*conf = loaded;
+	K_SPINLOCK(&conf_lock) {
+		persisted = loaded;
+		persisted_valid = true;
+	}
+	LOG_INF("Loaded saved config");
+	return 0;
+}
+
+#define CONF_MERGE(conf, changes, fields, bit, field)	\
+	do {							\
+		if ((fields) & (bit)) {				\
+			(conf)->field = (changes)->field;	\
+		}						\
+	} while (0)
+
+int at_config_stage(const struct at_config *live, const struct at_config *changes,
+		    uint32_t fields)
+{
+	struct at_config conf;
+	int err = 0;
+
+	// Read, merge and stage in one go so a concurrent change is not lost
+	K_SPINLOCK(&conf_lock) {
+		conf = staged_pending ? staged : *live;
+		CONF_MERGE(&conf, changes, fields, AT_CONF_LINK_TYPE, sid_link_type);
+		CONF_MERGE(&conf, changes, fields, AT_CONF_MOTION_PERIOD, motion_period);
+		CONF_MERGE(&conf, changes, fields, AT_CONF_SCAN_MOTION, scan_freq_motion);
+		CONF_MERGE(&conf, changes, fields, AT_CONF_MOTION_THRES, motion_thres);
+		CONF_MERGE(&conf, changes, fields, AT_CONF_SCAN_STATIC, scan_freq_static);
+		CONF_MERGE(&conf, changes, fields, AT_CONF_BATCH_SIZE, batch_size);
+		CONF_MERGE(&conf, changes, fields, AT_CONF_UPLINK_ACK, uplink_ack);
+		CONF_MERGE(&conf, changes, fields, AT_CONF_UPLINK_RETRIES, uplink_retries);
+
+		err = at_config_validate(&conf);
+		if (err == 0) {
+			staged = conf;
+			staged_pending = true;
+		}
+	}
+
+	if (err) {
+		return err;
+	}
+	at_event_send(EVENT_CONFIG_UPDATE);
+	return 0;
+}
+
+static void save_work_handler(struct k_work *work)
+{
+	struct at_config conf;
+	uint8_t record[AT_CONFIG_RECORD_SIZE];
+	bool dirty = false;
+
+	ARG_UNUSED(work);
+
+	K_SPINLOCK(&conf_lock) {
+		conf = pending;
+		dirty = !persisted_valid || !conf_equal(&conf, &persisted);
+	}
+
+	// A burst that ended where it started costs no write at all
+	if (!dirty) {
+		conf_stats.unchanged++;
+		return;
+	}
+
+	conf_encode(&conf, record);
+
+	int err = settings_save_one(AT_CONFIG_SUBTREE "/" AT_CONFIG_KEY, record, sizeof(record));
+
+	if (err) {
+		conf_stats.errors++;
+		LOG_ERR("Saving config failed: %d", err);
+		return;
+	}
+
+	K_SPINLOCK(&conf_lock) {
+		persisted = conf;
+		persisted_valid = true;
+	}
+	conf_stats.writes++;
+	LOG_INF("Config saved");
+}
+
+bool at_config_apply(struct at_config *live)
+{
+	bool applied = false;
+
+	// Readers in timer callbacks never see a half written config
+	K_SPINLOCK(&conf_lock) {
+		if (staged_pending) {
+			*live = staged;
+			pending = staged;
+			staged_pending = false;
+			applied = true;
+		}
+	}
+
+	if (!applied) {
+		return false;
+	}
+
+	conf_stats.changes++;
+	k_work_reschedule(&save_work, K_SECONDS(CONFIG_CONFIG_SAVE_DELAY_S));
+	return true;
+}
+
+void at_config_stats_get(struct at_config_stats *stats)
+{
+	*stats = conf_stats;
+}
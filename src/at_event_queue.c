@@ -0,0 +1,209 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include <asset_tracker.h>
+#include "at_event_queue.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(at_event_queue, CONFIG_TRACKER_LOG_LEVEL);
+
+/* Ordered lane - events whose order and multiplicity matter */
+K_MSGQ_DEFINE(at_thread_msgq, sizeof(at_event_t), CONFIG_SIDEWALK_THREAD_QUEUE_SIZE, 4);
+
+/* Coalescing lane - one pending bit per idempotent event */
+static atomic_t pending_events;
+static struct k_poll_signal pending_signal = K_POLL_SIGNAL_INITIALIZER(pending_signal);
+
+static atomic_t stat_sent[AT_EVENT_COUNT];
+static atomic_t stat_coalesced[AT_EVENT_COUNT];
+static atomic_t stat_dropped[AT_EVENT_COUNT];
+static atomic_t stat_fifo_hwm;
+static atomic_t stat_pending_hwm;
+
+/* SIDEWALK_EVENT dispatch latency - from on_event to sid_process() */
+static uint32_t sidewalk_event_posted;
+static uint32_t sid_latency_count;
+static uint32_t sid_latency_last;
+static uint32_t sid_latency_max;
+static uint64_t sid_latency_total;
+
+/* Coalesced events served after the ordered lane, in this order */
+static const at_event_t coalesce_order[] = {
+	MOTION_EVENT,
+	EVENT_BLE_CONNECTION_WAIT,
+	EVENT_SCAN_SENSORS,
+	EVENT_SCAN_LOC,
+	EVENT_STORAGE_DRAIN,
+	EVENT_UPLINK_RETRY,
+};
+
+static const char *const event_names[AT_EVENT_COUNT] = {
+	[SIDEWALK_EVENT] = "SIDEWALK_EVENT",
+	[BUTTON_EVENT_SHORT] = "BUTTON_EVENT_SHORT",
+	[BUTTON_EVENT_LONG] = "BUTTON_EVENT_LONG",
+	[MOTION_EVENT] = "MOTION_EVENT",
+	[EVENT_RADIO_SWITCH] = "EVENT_RADIO_SWITCH",
+	[EVENT_BLE_CONNECTION_REQUEST] = "EVENT_BLE_CONNECTION_REQUEST",
+	[EVENT_BLE_CONNECTION_WAIT] = "EVENT_BLE_CONNECTION_WAIT",
+	[EVENT_SCAN_LOC] = "EVENT_SCAN_LOC",
+	[EVENT_SEND_UPLINK] = "EVENT_SEND_UPLINK",
+	[EVENT_SCAN_SENSORS] = "EVENT_SCAN_SENSORS",
+	[EVENT_CONFIG_UPDATE] = "EVENT_CONFIG_UPDATE",
+	[EVENT_SID_START] = "EVENT_SID_START",
+	[EVENT_SID_STOP] = "EVENT_SID_STOP",
+	[EVENT_UPLINK_COMPLETE] = "EVENT_UPLINK_COMPLETE",
+	[EVENT_BLE_LOCATION_START] = "EVENT_BLE_LOCATION_START",
+	[EVENT_BLE_LOCATION_READY] = "EVENT_BLE_LOCATION_READY",
+	[EVENT_RESTORE_FULL_STACK] = "EVENT_RESTORE_FULL_STACK",
+	[EVENT_FACTORY_RESET] = "EVENT_FACTORY_RESET",
+	[EVENT_SENSORS_READY] = "EVENT_SENSORS_READY",
+	[EVENT_LOCATION_SCANNED] = "EVENT_LOCATION_SCANNED",
+	[EVENT_LOCATION_DONE] = "EVENT_LOCATION_DONE",
+	[EVENT_CYCLE_TIMEOUT] = "EVENT_CYCLE_TIMEOUT",
+	[EVENT_STORAGE_DRAIN] = "EVENT_STORAGE_DRAIN",
+	[EVENT_UPLINK_RETRY] = "EVENT_UPLINK_RETRY",
+	[EVENT_BLE_L1_TIMEOUT] = "EVENT_BLE_L1_TIMEOUT",
+};
+
+static void stat_max(atomic_t *stat, atomic_val_t val)
+{
+	atomic_val_t cur = atomic_get(stat);
+
+	while (val > cur && !atomic_cas(stat, cur, val)) {
+		cur = atomic_get(stat);
+	}
+}
+
+void at_event_send(at_event_t event)
+{
+	if (event >= AT_EVENT_COUNT) {
+		LOG_ERR("Invalid event %d", event);
+		return;
+	}
+
+	atomic_inc(&stat_sent[event]);
+
+	if (BIT(event) & AT_EVENT_COALESCE_MASK) {
+		if (atomic_test_and_set_bit(&pending_events, event)) {
+			atomic_inc(&stat_coalesced[event]);
+		} else {
+			if (event == SIDEWALK_EVENT) {
+				sidewalk_event_posted = k_cycle_get_32();
+			}
+			stat_max(&stat_pending_hwm, POPCOUNT(atomic_get(&pending_events)));
+		}
+		k_poll_signal_raise(&pending_signal, event);
+		return;
+	}
+
+	int ret = k_msgq_put(&at_thread_msgq, (void *)&event,
+			     k_is_in_isr() ? K_NO_WAIT : K_FOREVER);
+
+	if (ret) {
+		atomic_inc(&stat_dropped[event]);
+		LOG_ERR("Failed to send %s to asset tracker thread. err: %d",
+			at_event_name(event), ret);
+		return;
+	}
+
+	stat_max(&stat_fifo_hwm, k_msgq_num_used_get(&at_thread_msgq));
+}
+
+static void sid_latency_record(void)
+{
+	uint32_t latency = k_cycle_get_32() - sidewalk_event_posted;
+
+	sid_latency_count++;
+	sid_latency_last = latency;
+	sid_latency_total += latency;
+	if (latency > sid_latency_max) {
+		sid_latency_max = latency;
+	}
+}
+
+static bool at_event_take(at_event_t *event)
+{
+	if (atomic_test_bit(&pending_events, SIDEWALK_EVENT)) {
+		sid_latency_record();
+		atomic_clear_bit(&pending_events, SIDEWALK_EVENT);
+		*event = SIDEWALK_EVENT;
+		return true;
+	}
+
+	if (!k_msgq_get(&at_thread_msgq, event, K_NO_WAIT)) {
+		return true;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(coalesce_order); i++) {
+		if (atomic_test_and_clear_bit(&pending_events, coalesce_order[i])) {
+			*event = coalesce_order[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int at_event_get(at_event_t *event, k_timeout_t timeout)
+{
+	struct k_poll_event poll_events[] = {
+		K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY,
+					 &pending_signal),
+		K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_MSGQ_DATA_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY,
+					 &at_thread_msgq),
+	};
+
+	while (true) {
+		if (at_event_take(event)) {
+			return 0;
+		}
+
+		// Reset before re-checking so a bit set after the check still wakes k_poll
+		k_poll_signal_reset(&pending_signal);
+		if (atomic_get(&pending_events) != 0 || k_msgq_num_used_get(&at_thread_msgq) != 0) {
+			continue;
+		}
+
+		poll_events[0].state = K_POLL_STATE_NOT_READY;
+		poll_events[1].state = K_POLL_STATE_NOT_READY;
+		int ret = k_poll(poll_events, ARRAY_SIZE(poll_events), timeout);
+		if (ret == -EAGAIN) {
+			return ret;
+		}
+	}
+}
+
+void at_event_purge(void)
+{
+	k_msgq_purge(&at_thread_msgq);
+	// Never drop pending stack work, sid_process() must still run
+	atomic_and(&pending_events, BIT(SIDEWALK_EVENT));
+}
+
+void at_event_stats_get(struct at_event_stats *stats)
+{
+	for (int i = 0; i < AT_EVENT_COUNT; i++) {
+		stats->sent[i] = atomic_get(&stat_sent[i]);
+		stats->coalesced[i] = atomic_get(&stat_coalesced[i]);
+		stats->dropped[i] = atomic_get(&stat_dropped[i]);
+	}
+	stats->fifo_hwm = atomic_get(&stat_fifo_hwm);
+	stats->pending_hwm = atomic_get(&stat_pending_hwm);
+	stats->sid_latency_count = sid_latency_count;
+	stats->sid_latency_last_us = k_cyc_to_us_floor32(sid_latency_last);
+	stats->sid_latency_max_us = k_cyc_to_us_floor32(sid_latency_max);
+	stats->sid_latency_mean_us = sid_latency_count ?
+		(uint32_t)k_cyc_to_us_floor64(sid_latency_total / sid_latency_count) : 0;
+}
+
+const char *at_event_name(at_event_t event)
+{
+	if (event >= AT_EVENT_COUNT || event_names[event] == NULL) {
+		return "UNKNOWN";
+	}
+	return event_names[event];
+}
@@ -0,0 +1,269 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+#include <asset_tracker.h>
+#include "at_location_policy.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(at_loc_policy, CONFIG_TRACKER_LOG_LEVEL);
+
+/* Stepdown timings of the profiles, ms */
+#define STEPDOWN_DEFAULT_MS 5000
+#define STEPDOWN_FAST_MS 2000
+
+/* GNSS failures at a site before it is treated as indoors */
+#define SITE_GNSS_FAIL_MAX 2
+
+static const char *const effort_names[] = {
+	[SID_LOCATION_EFFORT_DEFAULT] = "auto",
+	[SID_LOCATION_EFFORT_L1] = "L1",
+	[SID_LOCATION_EFFORT_L2] = "L2",
+	[SID_LOCATION_EFFORT_L3] = "L3",
+	[SID_LOCATION_EFFORT_L4] = "L4",
+};
+
+/* What is known about the current site, reset when the device moves */
+static enum sid_location_effort_mode site_effort = SID_LOCATION_EFFORT_DEFAULT;
+static uint8_t site_gnss_fails;
+
+static int64_t last_fix_ms = -1;
+
+static bool gnss_forced;
+static struct at_gnss_choice gnss_forced_choice;
+static struct at_gnss_stats gnss_stats[GNSS_MODE_COUNT][GNSS_CONST_COUNT];
+static struct at_gnss_stats *gnss_pending;
+
+static struct at_loc_log_entry decision_log[LOC_POLICY_LOG_LEN];
+static uint32_t decision_count;
+static struct at_loc_log_entry *pending;
+static int64_t pending_start_ms;
+static bool pending_scanned;
+
+static void profile_set(struct at_loc_profile *profile, enum sid_location_effort_mode max_effort,
+			uint32_t stepdown_ms)
+{
+	*profile = (struct at_loc_profile){
+		.max_effort = max_effort,
+		.l4_to_l3_ms = stepdown_ms,
+		.l3_to_l2_ms = stepdown_ms,
+		.l2_to_l1_ms = stepdown_ms,
+	};
+}
+
+void at_loc_policy_default(struct at_loc_profile *profile)
+{
+	profile_set(profile, SID_LOCATION_EFFORT_L4, STEPDOWN_DEFAULT_MS);
+}
+
+static const char *decide(const struct at_loc_inputs *in, uint32_t fix_age_s,
+			  struct at_loc_profile *profile)
+{
+	// Without LoRa there is only the BLE gateway location
+	if ((in->link_mask & LORA_LM) == 0) {
+		profile_set(profile, SID_LOCATION_EFFORT_L1, STEPDOWN_FAST_MS);
+		return "ble link";
+	}
+
+	if (in->batt <= CONFIG_LOC_LOW_BATT_PCT / 2) {
+		profile_set(profile, SID_LOCATION_EFFORT_L2, STEPDOWN_FAST_MS);
+		return "critical battery";
+	}
+
+	if (in->motion) {
+		// Wherever it stops is a new site
+		site_effort = SID_LOCATION_EFFORT_DEFAULT;
+		site_gnss_fails = 0;
+		if (in->batt <= CONFIG_LOC_LOW_BATT_PCT) {
+			profile_set(profile, SID_LOCATION_EFFORT_L3, STEPDOWN_FAST_MS);
+			return "moving, low battery";
+		}
+		at_loc_policy_default(profile);
+		return "moving";
+	}
+
+	// Parked with a fresh fix, the position has not changed
+	if (fix_age_s < CONFIG_LOC_FIX_MAX_AGE_M * 60) {
+		profile_set(profile, SID_LOCATION_EFFORT_L2, STEPDOWN_FAST_MS);
+		return "parked, fix fresh";
+	}
+
+	// GNSS keeps failing here, start where it last worked
+	if (site_gnss_fails >= SITE_GNSS_FAIL_MAX) {
+		profile_set(profile, SID_LOCATION_EFFORT_L3, STEPDOWN_FAST_MS);
+		return "parked, indoors";
+	}
+
+	if (site_effort != SID_LOCATION_EFFORT_DEFAULT) {
+		profile_set(profile, site_effort, STEPDOWN_DEFAULT_MS);
+		return "parked, site effort";
+	}
+
+	if (in->batt <= CONFIG_LOC_LOW_BATT_PCT) {
+		profile_set(profile, SID_LOCATION_EFFORT_L3, STEPDOWN_FAST_MS);
+		return "parked, low battery";
+	}
+
+	at_loc_policy_default(profile);
+	return "parked, new site";
+}
+
+void at_loc_policy_decide(const struct at_loc_inputs *in, struct at_loc_profile *profile)
+{
+	int64_t now = k_uptime_get();
+	uint32_t fix_age_s = (last_fix_ms < 0) ? UINT32_MAX :
+			     (uint32_t)((now - last_fix_ms) / MSEC_PER_SEC);
+	const char *reason = decide(in, fix_age_s, profile);
+	struct at_loc_log_entry *entry = &decision_log[decision_count % LOC_POLICY_LOG_LEN];
+
+	*entry = (struct at_loc_log_entry){
+		.uptime_s = now / MSEC_PER_SEC,
+		.fix_age_s = fix_age_s,
+		.batt = in->batt,
+		.motion = in->motion,
+		.site_effort = site_effort,
+		.max_effort = profile->max_effort,
+		.reason = reason,
+	};
+	decision_count++;
+	pending = entry;
+	pending_start_ms = now;
+	pending_scanned = false;
+	gnss_pending = NULL;
+
+	LOG_INF("Location effort %s (%s): batt %u%%, fix age %d s, site %s",
+		effort_names[profile->max_effort], reason, in->batt,
+		(fix_age_s == UINT32_MAX) ? -1 : (int)fix_age_s, effort_names[site_effort]);
+}
+
+void at_loc_policy_scanned(enum sid_location_effort_mode effort)
+{
+	if (pending == NULL || pending_scanned) {
+		return;
+	}
+
+	pending_scanned = true;
+	pending->result_effort = effort;
+	pending->duration_ms = k_uptime_get() - pending_start_ms;
+
+	if (gnss_pending != NULL) {
+		gnss_pending->scans++;
+		gnss_pending->last_ms = pending->duration_ms;
+		gnss_pending->total_ms += pending->duration_ms;
+	}
+}
+
+void at_loc_policy_outcome(enum at_loc_outcome outcome, enum sid_location_effort_mode effort)
+{
+	bool success = (outcome != AT_LOC_FAILED);
+
+	if (pending == NULL) {
+		return;
+	}
+
+	// A failed scan ends here without a result
+	at_loc_policy_scanned(effort);
+	pending->done = true;
+	pending->outcome = outcome;
+	pending->result_effort = effort;
+
+	if (gnss_pending != NULL) {
+		if (success && effort == SID_LOCATION_EFFORT_L4) {
+			gnss_pending->fixes++;
+			gnss_pending->fix_ms += pending->duration_ms;
+		}
+		gnss_pending = NULL;
+	}
+
+	// Only WiFi and GNSS give a position, remember what worked at this site
+	if (success && effort >= SID_LOCATION_EFFORT_L3) {
+		last_fix_ms = k_uptime_get();
+		site_effort = effort;
+	}
+	if (pending->max_effort == SID_LOCATION_EFFORT_L4) {
+		if (success && effort == SID_LOCATION_EFFORT_L4) {
+			site_gnss_fails = 0;
+		} else {
+			site_gnss_fails++;
+		}
+	}
+
+	LOG_INF("Location outcome: %s at %s, scan %u ms (decided %s, %s)",
+		(outcome == AT_LOC_SENT) ? "sent" :
+		(outcome == AT_LOC_UNCHANGED) ? "unchanged" : "failed",
+		effort_names[effort], pending->duration_ms,
+		effort_names[pending->max_effort], pending->reason);
+	pending = NULL;
+}
+
+static const char *gnss_decide(const struct at_loc_inputs *in, struct at_gnss_choice *choice)
+{
+	uint32_t fix_age_s = (last_fix_ms < 0) ? UINT32_MAX :
+			     (uint32_t)((k_uptime_get() - last_fix_ms) / MSEC_PER_SEC);
+
+	choice->mode = IS_ENABLED(CONFIG_GNSS_SCAN_MODE_STATIC) ? GNSS_MODE_STATIC :
+								  GNSS_MODE_MOBILE;
+	choice->constellation = GNSS_CONST_GPS_BEIDOU;
+
+	// BeiDou satellites would only be searched with stale orbits
+	if (in->beidou_almanac_age_d != UINT16_MAX &&
+	    in->beidou_almanac_age_d > CONFIG_GNSS_ALMANAC_MAX_AGE_D) {
+		choice->constellation = GNSS_CONST_GPS;
+	}
+
+	if (in->motion) {
+		choice->mode = GNSS_MODE_MOBILE;
+		return "moving";
+	}
+	if (fix_age_s >= CONFIG_LOC_FIX_MAX_AGE_M * 60) {
+		choice->mode = GNSS_MODE_STATIC;
+		return "parked, fix stale";
+	}
+	return "default";
+}
+
+void at_loc_policy_gnss(const struct at_loc_inputs *in, struct at_gnss_choice *choice)
+{
+	static const char *const mode_names[] = { "mobile", "static" };
+	static const char *const const_names[] = { "GPS+BeiDou", "GPS", "BeiDou" };
+
+	if (gnss_forced) {
+		*choice = gnss_forced_choice;
+		choice->reason = "override";
+	} else {
+		choice->reason = gnss_decide(in, choice);
+	}
+	gnss_pending = &gnss_stats[choice->mode][choice->constellation];
+
+	LOG_INF("GNSS %s, %s (%s), BeiDou almanac age %d d", mode_names[choice->mode],
+		const_names[choice->constellation], choice->reason,
+		(in->beidou_almanac_age_d == UINT16_MAX) ? -1 : (int)in->beidou_almanac_age_d);
+}
+
+void at_loc_policy_gnss_override(const struct at_gnss_choice *choice)
+{
+	gnss_forced = (choice != NULL);
+	if (gnss_forced) {
+		gnss_forced_choice = *choice;
+	}
+}
+
+void at_loc_policy_gnss_stats_get(struct at_gnss_stats stats[GNSS_MODE_COUNT][GNSS_CONST_COUNT])
+{
+	memcpy(stats, gnss_stats, sizeof(gnss_stats));
+}
+
+size_t at_loc_policy_log_get(struct at_loc_log_entry *log, size_t max)
+{
+	size_t count = MIN(MIN(decision_count, LOC_POLICY_LOG_LEN), max);
+	uint32_t first = decision_count - count;
+
+	for (size_t i = 0; i < count; i++) {
+		log[i] = decision_log[(first + i) % LOC_POLICY_LOG_LEN];
+	}
+	return count;
+}
@@ -0,0 +1,181 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#include <stdlib.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+#include <asset_tracker.h>
+#include "at_scheduler.h"
+#include "peripherals/at_timers.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(at_scheduler, CONFIG_TRACKER_LOG_LEVEL);
+
+static const struct at_config *sched_conf;
+
+/*
+ * at_scheduler_next() runs in the scan timer ISR, everything it touches is
+ * under sched_lock. The cadence is copied from sched_conf on init and on
+ * reconfigure, so the ISR never reads the live config.
+ */
+static struct k_spinlock sched_lock;
+static uint32_t motion_s;		// scan_freq_motion
+static uint32_t static_s;		// scan_freq_static, in s
+static int64_t motion_period_ms;
+static int64_t last_motion_ms = -1;
+static uint32_t static_interval_s;
+static struct at_scheduler_stats sched_stats;
+
+static bool accel_valid;
+static int32_t prev_accel_mg[3];
+
+static void cadence_load(void)
+{
+	motion_s = sched_conf->scan_freq_motion;
+	static_s = (uint32_t)sched_conf->scan_freq_static * 60;
+	motion_period_ms = (int64_t)sched_conf->motion_period * 60 * MSEC_PER_SEC;
+	// Restart the static back-off from the motion cadence
+	static_interval_s = motion_s;
+}
+
+static bool in_motion_locked(void)
+{
+	return last_motion_ms >= 0 && (k_uptime_get() - last_motion_ms) < motion_period_ms;
+}
+
+/**
+ * Interval of the scan about to be armed. A scan that is being scheduled
+ * moves the parked back-off on and is counted, a re-arm is not.
+ */
+static uint32_t interval_locked(bool scan)
+{
+	uint32_t interval_s;
+	bool moving = in_motion_locked();
+
+	if (moving) {
+		static_interval_s = motion_s;
+		interval_s = motion_s;
+	} else {
+		// Parked - back off towards the static cadence
+		if (scan) {
+			static_interval_s = MIN(static_interval_s * 2, static_s);
+		}
+		interval_s = MAX(static_interval_s, motion_s);
+	}
+
+	if (scan) {
+		if (moving) {
+			sched_stats.scans_motion++;
+		} else {
+			sched_stats.scans_static++;
+		}
+	}
+	sched_stats.interval_s = interval_s;
+	return interval_s;
+}
+
+void at_scheduler_init(const struct at_config *conf)
+{
+	K_SPINLOCK(&sched_lock) {
+		sched_conf = conf;
+		cadence_load();
+	}
+}
+
+bool at_scheduler_in_motion(void)
+{
+	bool moving = false;
+
+	K_SPINLOCK(&sched_lock) {
+		moving = in_motion_locked();
+	}
+	return moving;
+}
+
+void at_scheduler_on_motion(void)
+{
+	bool was_moving = false;
+
+	K_SPINLOCK(&sched_lock) {
+		was_moving = in_motion_locked();
+		last_motion_ms = k_uptime_get();
+		sched_stats.motion_events++;
+		if (!was_moving) {
+			static_interval_s = motion_s;
+		}
+	}
+
+	if (was_moving) {
+		return;
+	}
+
+	// Start of motion - scan soon instead of waiting out the parked interval
+	if (scan_timer_remaining_ms() > MOTION_PULL_IN_S * MSEC_PER_SEC) {
+		LOG_INF("Motion started, pulling next scan in");
+		K_SPINLOCK(&sched_lock) {
+			sched_stats.pull_ins++;
+		}
+		scan_timer_set_and_run(K_SECONDS(MOTION_PULL_IN_S));
+	}
+}
+
+bool at_scheduler_accel_update(const struct at_sensors *sensors)
+{
+	const int32_t cur_mg[3] = {
+		sensors->accel_x_mg,
+		sensors->accel_y_mg,
+		sensors->accel_z_mg,
+	};
+	int32_t thres_mg = (int32_t)sched_conf->motion_thres * MOTION_THRES_MG_PER_LSB;
+	bool moved = false;
+
+	for (int i = 0; i < ARRAY_SIZE(cur_mg); i++) {
+		if (accel_valid && abs(cur_mg[i] - prev_accel_mg[i]) > thres_mg) {
+			moved = true;
+		}
+		prev_accel_mg[i] = cur_mg[i];
+	}
+	accel_valid = true;
+
+	return moved;
+}
+
+k_timeout_t at_scheduler_next(void)
+{
+	uint32_t interval_s = 0;
+
+	// Called from the scan timer ISR, no logging here
+	K_SPINLOCK(&sched_lock) {
+		interval_s = interval_locked(true);
+	}
+	return K_SECONDS(interval_s);
+}
+
+void at_scheduler_reconfigure(void)
+{
+	uint32_t interval_s = 0;
+	bool moving = false;
+
+	K_SPINLOCK(&sched_lock) {
+		cadence_load();
+		moving = in_motion_locked();
+		interval_s = interval_locked(false);
+	}
+
+	// Not armed yet, the first scan picks the new cadence up
+	if (scan_timer_remaining_ms() == 0) {
+		return;
+	}
+	LOG_INF("Cadence changed, next scan in %u s (%s)", interval_s,
+		moving ? "motion" : "static");
+	scan_timer_set_and_run(K_SECONDS(interval_s));
+}
+
+void at_scheduler_stats_get(struct at_scheduler_stats *stats)
+{
+	K_SPINLOCK(&sched_lock) {
+		*stats = sched_stats;
+	}
+}
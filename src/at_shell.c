@@ -9,6 +9,16 @@
 #include <zephyr/kernel.h>
 #include <zephyr/shell/shell.h>
 #include "at_shell.h"
+#include "at_config.h"
+#include "at_event_queue.h"
+#include "at_location_policy.h"
+#include "at_wifi_fingerprint.h"
+#include "at_scheduler.h"
+#include "sidewalk/at_uplink.h"
+#include "sidewalk/at_downlink.h"
+#include "peripherals/at_battery.h"
+#include "peripherals/at_lis3dh.h"
+#include "peripherals/at_storage.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(at_shell, CONFIG_TRACKER_LOG_LEVEL);
@@ -29,6 +39,7 @@ static int cmd_enter_bootloader(const struct shell *sh, size_t argc, char **argv
 }
 
 static int cmd_config_radio(const struct shell *sh, size_t argc, char **argv) {
+	struct at_config conf;
 
 	if (strlen(argv[1]) != 1) {
 		shell_error(sh, "invalid radio type");
@@ -37,20 +48,60 @@ static int cmd_config_radio(const struct shell *sh, size_t argc, char **argv) {
 
 	switch (argv[1][0]) {
 	case '1':
-		atcontext->at_conf.sid_link_type = BLE_LM;
+		conf.sid_link_type = BLE_LM;
 		shell_print(sh, "BLE radio type set for Sidewalk communications.");
-		at_event_send(EVENT_RADIO_SWITCH);
 		break;
 	case '2':
-		atcontext->at_conf.sid_link_type = LORA_LM;
+		conf.sid_link_type = LORA_LM;
 		shell_print(sh, "LoRa radio type set for Sidewalk communications.");
-		at_event_send(EVENT_RADIO_SWITCH);
 		break;
 	default:
 		shell_error(sh, "radio type invalid. 1=ble, 2=lora");
 		return CMD_RETURN_ARGUMENT_INVALID;
 	}
 
+	// Both go through the ordered lane, the new link type is live before the switch
+	at_config_stage(&atcontext->at_conf, &conf, AT_CONF_LINK_TYPE);
+	at_event_send(EVENT_RADIO_SWITCH);
+	return 0;
+}
+
+static int cmd_config_batch(const struct shell *sh, size_t argc, char **argv) {
+	int size = atoi(argv[1]);
+
+	if (size < 1 || size > TELEMETRY_BATCH_MAX) {
+		shell_error(sh, "batch size invalid, 1-%d", TELEMETRY_BATCH_MAX);
+		return CMD_RETURN_ARGUMENT_INVALID;
+	}
+
+	struct at_config conf;
+
+	conf.batch_size = size;
+	at_config_stage(&atcontext->at_conf, &conf, AT_CONF_BATCH_SIZE);
+	shell_print(sh, "Telemetry batch size set to %d", size);
+	return 0;
+}
+
+static int cmd_config_ack(const struct shell *sh, size_t argc, char **argv) {
+	int retries = (argc > 2) ? atoi(argv[2]) : atcontext->at_conf.uplink_retries;
+
+	if (strlen(argv[1]) != 1 || (argv[1][0] != '0' && argv[1][0] != '1') ||
+	    retries < 0 || retries > AT_CONF_RETRIES_MAX) {
+		shell_error(sh, "usage: ack <0|1> [retries 0-7]");
+		return CMD_RETURN_ARGUMENT_INVALID;
+	}
+
+	struct at_config conf;
+	uint32_t fields = AT_CONF_UPLINK_ACK;
+
+	conf.uplink_ack = (argv[1][0] == '1');
+	if (argc > 2) {
+		conf.uplink_retries = retries;
+		fields |= AT_CONF_UPLINK_RETRIES;
+	}
+	at_config_stage(&atcontext->at_conf, &conf, fields);
+	shell_print(sh, "Telemetry uplinks %s, %d retries", 
+		conf.uplink_ack ? "acked" : "unacked", retries);
 	return 0;
 }
 
@@ -65,9 +116,249 @@ static int cmd_print_status(const struct shell *sh, size_t argc, char **argv) {
 	shell_print(sh, "Link Type: %s", 
 		(atcontext->at_conf.sid_link_type == BLE_LM) ? "BLE" : 
 		(atcontext->at_conf.sid_link_type == LORA_LM) ? "LoRa" : "Unknown");
-	shell_print(sh, "Battery: %d%%", atcontext->sensors.batt);
-	shell_print(sh, "Temperature: %.1f C", atcontext->sensors.temp);
-	shell_print(sh, "Humidity: %.1f %%", atcontext->sensors.hum);
+	struct at_battery_stats batt;
+
+	at_battery_stats_get(&batt);
+	shell_print(sh, "Battery: %d%% (%u mV, min %u mV, %u samples, %u after TX)",
+		atcontext->sensors.batt, batt.mv, batt.min_mv, batt.samples, batt.tx_samples);
+	shell_print(sh, "Temperature: %s%d.%d C", (atcontext->sensors.temp_mc < 0) ? "-" : "",
+		abs(atcontext->sensors.temp_mc) / 1000, (abs(atcontext->sensors.temp_mc) % 1000) / 100);
+	shell_print(sh, "Humidity: %d.%d %%", atcontext->sensors.hum_mpct / 1000,
+		(atcontext->sensors.hum_mpct % 1000) / 100);
+	shell_print(sh, "Acceleration: %u mg", atcontext->sensors.peak_accel_mg);
+	shell_print(sh, "BLE conn wait: %u attempts, %u timeouts, wakeups last=%u max=%u",
+		atcontext->ble_wait.attempts, atcontext->ble_wait.timeouts,
+		atcontext->ble_wait.last_wakeups, atcontext->ble_wait.max_wakeups);
+
+	struct at_uplink_stats uplink;
+
+	at_uplink_stats_get(&uplink);
+	shell_print(sh, "Uplinks (%s): %u queued, %u sent (%u first try), %u retries, %u lost",
+		atcontext->at_conf.uplink_ack ? "acked" : "unacked", uplink.queued, uplink.sent,
+		uplink.first_try, uplink.retries, uplink.failed);
+	shell_print(sh, "  in flight %u (max %u/%u), buffer waits %u, last MTU %u, "
+		"delta fallbacks %u", uplink.in_flight, uplink.in_flight_hwm, UPLINK_BUF_COUNT,
+		uplink.buf_waits, uplink.mtu, uplink.encode_fallbacks);
+
+	struct at_config_stats conf_stats;
+
+	at_config_stats_get(&conf_stats);
+	shell_print(sh, "Config: %u changes, %u flash writes, %u unchanged, %u errors",
+		conf_stats.changes, conf_stats.writes, conf_stats.unchanged, conf_stats.errors);
+
+	struct at_scheduler_stats sched;
+
+	at_scheduler_stats_get(&sched);
+	shell_print(sh, "Scheduler: %s, next interval %u s, scans motion=%u static=%u, "
+		"motion events=%u, pull-ins=%u", at_scheduler_in_motion() ? "motion" : "static",
+		sched.interval_s, sched.scans_motion, sched.scans_static, sched.motion_events,
+		sched.pull_ins);
+	return 0;
+}
+
+static int cmd_print_events(const struct shell *sh, size_t argc, char **argv) {
+	struct at_event_stats stats;
+
+	at_event_stats_get(&stats);
+	shell_print(sh, "Ordered lane high-water: %u/%u", stats.fifo_hwm,
+		CONFIG_SIDEWALK_THREAD_QUEUE_SIZE);
+	shell_print(sh, "Coalesced lane high-water: %u", stats.pending_hwm);
+	shell_print(sh, "sid_process dispatch latency: n=%u last=%uus mean=%uus max=%uus",
+		stats.sid_latency_count, stats.sid_latency_last_us, stats.sid_latency_mean_us,
+		stats.sid_latency_max_us);
+	shell_print(sh, "%-30s %8s %8s %8s", "Event", "Sent", "Coalesce", "Dropped");
+	for (int i = 0; i < AT_EVENT_COUNT; i++) {
+		if (stats.sent[i] == 0) {
+			continue;
+		}
+		shell_print(sh, "%-30s %8u %8u %8u", at_event_name(i), stats.sent[i],
+			stats.coalesced[i], stats.dropped[i]);
+	}
+	return 0;
+}
+
+static int cmd_print_timing(const struct shell *sh, size_t argc, char **argv) {
+	static const char *const l1_paths[] = { "re-init", "link switch" };
+
+	shell_print(sh, "Current state: %s", at_sm_state_name(atcontext->sm_state));
+	shell_print(sh, "%-10s %8s %10s %12s", "State", "Entries", "Last ms", "Total ms");
+	for (int i = AT_SM_INIT; i < AT_SM_COUNT; i++) {
+		const struct at_state_timing *timing = &atcontext->sm_timing[i];
+
+		shell_print(sh, "%-10s %8u %10u %12llu", at_sm_state_name(i), timing->entries,
+			k_cyc_to_ms_floor32(timing->last_cycles),
+			k_cyc_to_ms_floor64(timing->total_cycles));
+	}
+
+	const struct at_cycle_report *report = &atcontext->cycle.last;
+
+	shell_print(sh, "Last cycle (%u): sensing %u ms, loc scan %u ms, loc send %u ms", 
+		report->count, report->sensing_ms, report->loc_scan_ms, report->loc_send_ms);
+	shell_print(sh, "  uplink %u ms, radio on %u ms, total %u ms, %u radio sessions%s",
+		report->uplink_ms, report->radio_ms, report->total_ms, report->radio_sessions,
+		report->bundled ? " (bundled)" : "");
+	shell_print(sh, "Radio sessions per location cycle: separate %u/%u, bundled %u/%u",
+		report->separate_sessions, report->separate_cycles, report->bundled_sessions,
+		report->bundled_cycles);
+
+	shell_print(sh, "%-12s %8s %8s %8s %10s %10s %10s %10s", "BLE L1", "Runs", "Fails",
+		"Timeouts", "Switch ms", "Avg ms", "Restore ms", "Avg ms");
+	for (int i = 0; i < BLE_L1_PATH_COUNT; i++) {
+		const struct ble_l1_timing *l1 = &atcontext->ble_l1[i];
+
+		shell_print(sh, "%-12s %8u %8u %8u %10u %10llu %10u %10llu", l1_paths[i],
+			l1->switches, l1->failures, l1->timeouts, l1->last_switch_ms, l1->switches ? l1->total_switch_ms / l1->switches : 0,
+			l1->last_restore_ms, l1->restores ? l1->total_restore_ms / l1->restores : 0);
+	}
+	return 0;
+}
+
+static int cmd_print_batch(const struct shell *sh, size_t argc, char **argv) {
+	shell_print(sh, "Current batch size: %u", atcontext->at_conf.batch_size);
+	shell_print(sh, "%-6s %7s %7s %10s %14s", "Batch", "Frames", "Bytes", "B/sample",
+		"Airtime/sample");
+	for (uint8_t n = 1; n <= TELEMETRY_BATCH_MAX; n++) {
+		uint32_t bytes = at_uplink_batch_bytes(n);
+		uint32_t airtime_us = at_uplink_batch_airtime_us(n);
+
+		shell_print(sh, "%-6u %7u %7u %7u.%02u %11u us", n, at_uplink_batch_frames(n),
+			bytes, bytes / n, (bytes % n) * 100 / n, airtime_us / n);
+	}
+	return 0;
+}
+
+static int cmd_print_storage(const struct shell *sh, size_t argc, char **argv) {
+	struct at_storage_stats stats;
+
+	at_storage_stats_get(&stats);
+	shell_print(sh, "Telemetry log: %u/%u records pending", stats.backlog, stats.capacity);
+	shell_print(sh, "Appended %u, drained %u, overwritten %u, torn %u", stats.appended,
+		stats.drained, stats.overwritten, stats.torn);
+	shell_print(sh, "Drain rate: %u records/min",
+		stats.drain_ms ? (uint32_t)((uint64_t)stats.drained * 60000 / stats.drain_ms) : 0);
+	return 0;
+}
+
+static int cmd_print_downlink(const struct shell *sh, size_t argc, char **argv) {
+	struct at_downlink_stats stats;
+
+	at_downlink_stats_get(&stats);
+	shell_print(sh, "Downlinks: %u received, %u handled, %u unknown, %u malformed",
+		stats.received, stats.handled, stats.unknown, stats.malformed);
+	shell_print(sh, "Receive queue: %u dropped, high-water %u/%u", stats.dropped,
+		stats.queue_hwm, RECEIVE_TASK_QUEUE_SIZE);
+	shell_print(sh, "RX to handled latency: n=%u last=%uus mean=%uus max=%uus",
+		stats.latency_count, stats.latency_last_us, stats.latency_mean_us,
+		stats.latency_max_us);
+	return 0;
+}
+
+static int cmd_print_accel(const struct shell *sh, size_t argc, char **argv) {
+	struct at_accel_stats stats;
+
+	if (!IS_ENABLED(CONFIG_ACCEL_FIFO)) {
+		shell_print(sh, "Accelerometer polled once per scan, FIFO streaming disabled");
+		return 0;
+	}
+
+	at_lis3dh_stats_get(&stats);
+	shell_print(sh, "FIFO: %u samples in %u reads (%u per wakeup), %u overruns",
+		stats.samples, stats.fifo_reads,
+		stats.fifo_reads ? stats.samples / stats.fifo_reads : 0, stats.overruns);
+	shell_print(sh, "Last window: %u samples, peak %u mg, rms %u mg", stats.window_samples,
+		stats.peak_mg, stats.rms_mg);
+	shell_print(sh, "Impacts: %u", stats.impacts);
+	return 0;
+}
+
+static int cmd_print_location_log(const struct shell *sh, size_t argc, char **argv) {
+	static const char *const efforts[] = { "auto", "L1", "L2", "L3", "L4" };
+	static struct at_loc_log_entry log[LOC_POLICY_LOG_LEN];
+	size_t count = at_loc_policy_log_get(log, ARRAY_SIZE(log));
+	struct at_wifi_fp_stats fp;
+
+	at_wifi_fp_stats_get(&fp);
+	shell_print(sh, "WiFi scene: %u compared, %u suppressed (%u B), %u sent (%u B), last %u%%",
+		fp.compared, fp.suppressed, fp.suppressed_bytes, fp.sent, fp.sent_bytes,
+		fp.last_similarity);
+
+	shell_print(sh, "%8s %6s %4s %4s %8s %4s %-20s %-9s %8s", "Uptime", "Motion", "Batt", "Site",
+		"Fix age", "Max", "Reason", "Result", "Scan ms");
+	for (size_t i = 0; i < count; i++) {
+		const struct at_loc_log_entry *e = &log[i];
+		char result[12] = "pending";
+
+		if (e->done) {
+			snprintf(result, sizeof(result), "%s %s",
+				(e->outcome == AT_LOC_SENT) ? "sent" :
+				(e->outcome == AT_LOC_UNCHANGED) ? "same" : "fail",
+				efforts[e->result_effort]);
+		}
+		shell_print(sh, "%8u %6s %3u%% %4s %8d %4s %-20s %-9s %8u", e->uptime_s,
+			e->motion ? "yes" : "no", e->batt, efforts[e->site_effort],
+			(e->fix_age_s == UINT32_MAX) ? -1 : (int)e->fix_age_s,
+			efforts[e->max_effort], e->reason, result, e->duration_ms);
+	}
+	return 0;
+}
+
+static int cmd_gnss(const struct shell *sh, size_t argc, char **argv) {
+	static const char *const modes[] = { "mobile", "static" };
+	static const char *const constellations[] = { "gps_beidou", "gps", "beidou" };
+	static struct at_gnss_stats stats[GNSS_MODE_COUNT][GNSS_CONST_COUNT];
+
+	if (argc > 1) {
+		struct at_gnss_choice choice = { .constellation = GNSS_CONST_GPS_BEIDOU };
+		int mode = -1;
+
+		if (strcmp(argv[1], "auto") == 0) {
+			at_loc_policy_gnss_override(NULL);
+			shell_print(sh, "GNSS choice back to the location policy");
+			return 0;
+		}
+		for (int i = 0; i < GNSS_MODE_COUNT; i++) {
+			if (strcmp(argv[1], modes[i]) == 0) {
+				mode = i;
+			}
+		}
+		if (mode < 0) {
+			shell_error(sh, "mode invalid: auto, mobile or static");
+			return CMD_RETURN_ARGUMENT_INVALID;
+		}
+		choice.mode = mode;
+		if (argc > 2) {
+			int constellation = -1;
+
+			for (int i = 0; i < GNSS_CONST_COUNT; i++) {
+				if (strcmp(argv[2], constellations[i]) == 0) {
+					constellation = i;
+				}
+			}
+			if (constellation < 0) {
+				shell_error(sh, "constellation invalid: gps_beidou, gps or beidou");
+				return CMD_RETURN_ARGUMENT_INVALID;
+			}
+			choice.constellation = constellation;
+		}
+		at_loc_policy_gnss_override(&choice);
+		shell_print(sh, "GNSS forced to %s, %s", modes[choice.mode],
+			constellations[choice.constellation]);
+		return 0;
+	}
+
+	at_loc_policy_gnss_stats_get(stats);
+	shell_print(sh, "%-7s %-11s %6s %6s %8s %10s %10s", "Mode", "Const", "Scans", "Fixes",
+		"Last ms", "Avg ms", "Avg fix ms");
+	for (int m = 0; m < GNSS_MODE_COUNT; m++) {
+		for (int c = 0; c < GNSS_CONST_COUNT; c++) {
+			const struct at_gnss_stats *st = &stats[m][c];
+
+			shell_print(sh, "%-7s %-11s %6u %6u %8u %10llu %10llu", modes[m],
+				constellations[c], st->scans, st->fixes, st->last_ms,
+				st->scans ? st->total_ms / st->scans : 0,
+				st->fixes ? st->fix_ms / st->fixes : 0);
+		}
+	}
 	return 0;
 }
 
@@ -82,6 +373,8 @@ static int cmd_factory_reset(const struct shell *sh, size_t argc, char **argv) {
 SHELL_STATIC_SUBCMD_SET_CREATE(
 	sub_config, 
 	SHELL_CMD_ARG(radio, NULL, "set sidewalk radio to use: 1=ble, 2=lora", cmd_config_radio, 2, 0),
+	SHELL_CMD_ARG(batch, NULL, "set telemetry samples per uplink: 1-8", cmd_config_batch, 2, 0),
+	SHELL_CMD_ARG(ack, NULL, "acked telemetry uplinks: 0=off, 1=on [retries 0-7]", cmd_config_ack, 2, 1),
 	SHELL_SUBCMD_SET_END
 );
 
@@ -89,6 +382,14 @@ SHELL_STATIC_SUBCMD_SET_CREATE(asset_tracker,
 	SHELL_CMD_ARG(status, NULL, "Print device status", cmd_print_status, 1, 0),
 	SHELL_CMD_ARG(config, &sub_config, "Device config menu", NULL, 1, 0),
 	SHELL_CMD_ARG(scan, NULL, "Trigger location scan", cmd_trigger_scan, 1, 0),
+	SHELL_CMD_ARG(events, NULL, "Print event queue statistics", cmd_print_events, 1, 0),
+	SHELL_CMD_ARG(timing, NULL, "Print per-state timing", cmd_print_timing, 1, 0),
+	SHELL_CMD_ARG(batch, NULL, "Print bytes and airtime per sample for each batch size", cmd_print_batch, 1, 0),
+	SHELL_CMD_ARG(storage, NULL, "Print store-and-forward log statistics", cmd_print_storage, 1, 0),
+	SHELL_CMD_ARG(accel, NULL, "Print accelerometer FIFO statistics", cmd_print_accel, 1, 0),
+	SHELL_CMD_ARG(location_log, NULL, "Print location effort decisions and outcomes", cmd_print_location_log, 1, 0),
+	SHELL_CMD_ARG(gnss, NULL, "GNSS scan stats, or force [auto|mobile|static] [gps_beidou|gps|beidou]", cmd_gnss, 1, 2),
+	SHELL_CMD_ARG(downlink, NULL, "Print downlink receive statistics", cmd_print_downlink, 1, 0),
 	SHELL_CMD_ARG(factory_reset, NULL, "Factory reset - clears Sidewalk registration, forces re-registration", cmd_factory_reset, 1, 0),
 	SHELL_CMD_ARG(enter_bootloader, NULL, "Enter bootloader for UF2 flashing", cmd_enter_bootloader, 1, 0),
 	SHELL_SUBCMD_SET_END
@@ -0,0 +1,102 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+#include <asset_tracker.h>
+#include "at_wifi_fingerprint.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(at_wifi_fp, CONFIG_TRACKER_LOG_LEVEL);
+
+/* Scan payload: optional 1 byte header, then RSSI (1) + BSSID (6) per AP */
+#define WIFI_AP_RECORD_SIZE 7
+#define WIFI_BSSID_SIZE 6
+
+/* Scene of the last WiFi location sent, the reference for later scans */
+static uint8_t last_bssid[WIFI_FP_MAX_AP][WIFI_BSSID_SIZE];
+static uint8_t last_count;
+static bool last_valid;
+static int64_t last_sent_ms = -1;
+static struct at_wifi_fp_stats fp_stats;
+
+static uint8_t parse_bssids(const uint8_t *payload, size_t size,
+			    uint8_t bssid[WIFI_FP_MAX_AP][WIFI_BSSID_SIZE])
+{
+	size_t offset = size % WIFI_AP_RECORD_SIZE;
+	uint8_t count = 0;
+
+	for (; offset + WIFI_AP_RECORD_SIZE <= size && count < WIFI_FP_MAX_AP;
+	     offset += WIFI_AP_RECORD_SIZE) {
+		memcpy(bssid[count++], &payload[offset + 1], WIFI_BSSID_SIZE);
+	}
+	return count;
+}
+
+static uint8_t similarity_pct(uint8_t bssid[WIFI_FP_MAX_AP][WIFI_BSSID_SIZE], uint8_t count)
+{
+	uint8_t common = 0;
+
+	for (uint8_t i = 0; i < count; i++) {
+		for (uint8_t j = 0; j < last_count; j++) {
+			if (memcmp(bssid[i], last_bssid[j], WIFI_BSSID_SIZE) == 0) {
+				common++;
+				break;
+			}
+		}
+	}
+
+	uint8_t total = count + last_count - common;
+
+	return total ? common * 100 / total : 0;
+}
+
+bool at_wifi_fp_unchanged(const uint8_t *payload, size_t size)
+{
+	uint8_t bssid[WIFI_FP_MAX_AP][WIFI_BSSID_SIZE];
+	uint8_t count = parse_bssids(payload, size, bssid);
+	bool unchanged = false;
+
+	if (last_valid && count > 0) {
+		uint8_t similarity = similarity_pct(bssid, count);
+		bool fresh = last_sent_ms >= 0 &&
+			     k_uptime_get() - last_sent_ms <
+				     (int64_t)CONFIG_LOC_WIFI_RESEND_M * 60 * MSEC_PER_SEC;
+
+		fp_stats.compared++;
+		fp_stats.last_similarity = similarity;
+		unchanged = CONFIG_LOC_WIFI_SIMILARITY_PCT > 0 && fresh &&
+			    similarity >= CONFIG_LOC_WIFI_SIMILARITY_PCT;
+		LOG_INF("WiFi scene %u%% similar over %u/%u APs%s", similarity, count, last_count,
+			unchanged ? ", send suppressed" : "");
+	}
+
+	// The reference stays the last sent scene, so slow drift adds up until
+	// it crosses the threshold and is sent
+	if (unchanged) {
+		fp_stats.suppressed++;
+		fp_stats.suppressed_bytes += size;
+	}
+	return unchanged;
+}
+
+void at_wifi_fp_sent(const uint8_t *payload, size_t size, bool wifi)
+{
+	fp_stats.sent++;
+	fp_stats.sent_bytes += size;
+	if (!wifi) {
+		return;
+	}
+
+	last_count = parse_bssids(payload, size, last_bssid);
+	last_valid = last_count > 0;
+	last_sent_ms = k_uptime_get();
+}
+
+void at_wifi_fp_stats_get(struct at_wifi_fp_stats *stats)
+{
+	*stats = fp_stats;
+}
@@ -202,10 +202,10 @@ int cmd_location_send(const struct shell *shell, int32_t argc, const char **argv
 
 	/* Special handling for L1 (BLE location) */
 	if (mode == SID_LOCATION_EFFORT_L1) {
-		shell_print(shell, "BLE location requested - switching to BLE-only mode...");
+		shell_print(shell, "BLE location requested - bringing up the BLE link...");
 		pending_shell = shell;
 		ble_location_pending = true;
-		/* Send event to switch to BLE-only and trigger L1 location */
+		/* Send event to bring up BLE and trigger L1 location */
 		at_event_send(EVENT_BLE_LOCATION_START);
 		return 0;
 	}
@@ -7,8 +7,11 @@
 
 #include "peripherals/at_led.h"
 #include "peripherals/at_button.h"
+#include "peripherals/at_battery.h"
 #include "peripherals/at_sht41.h"
 #include "peripherals/at_lis3dh.h"
+#include "peripherals/at_sensors.h"
+#include "peripherals/at_storage.h"
 #include "peripherals/at_usb.h"
 
 #include <zephyr/logging/log.h>
@@ -30,6 +33,9 @@ int main(void)
 	init_at_button();
 	init_at_sht41();
 	init_at_lis3dh();
+	init_at_battery();
+	init_at_sensors();
+	init_at_storage();
 
 	LOG_INF("Starting Sidewalk Asset Tracker...");
 
@@ -1,17 +1,213 @@
 // Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
 // SPDX-License-Identifier: MIT-0
 
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/adc.h>
+#include <zephyr/sys/atomic.h>
+
 #include "asset_tracker.h"
 #include "peripherals/at_battery.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(at_battery, CONFIG_TRACKER_LOG_LEVEL);
 
+#if !DT_NODE_HAS_PROP(DT_PATH(zephyr_user), io_channels)
+#error "No VBAT io-channels in the zephyr,user node"
+#endif
+
+static const struct adc_dt_spec vbat = ADC_DT_SPEC_GET(DT_PATH(zephyr_user));
+
+/* Ignore TX triggered samples closer together than this */
+#define BATT_TX_SAMPLE_MIN_S 60
+/* Time after a TX before the cell counts as rested again */
+#define BATT_REST_MS 5000
+
+/**
+ * Single cell Li-ion open circuit voltage to state of charge, highest first.
+ * Linear between points.
+ */
+static const struct {
+	uint16_t mv;
+	uint8_t pct;
+} soc_table[] = {
+	{ 4200, 100 },
+	{ 4100, 90 },
+	{ 4000, 80 },
+	{ 3900, 65 },
+	{ 3800, 50 },
+	{ 3750, 40 },
+	{ 3700, 30 },
+	{ 3650, 20 },
+	{ 3600, 10 },
+	{ 3500, 5 },
+	{ 3300, 0 },
+};
+
+static void batt_work_handler(struct k_work *work);
+static void batt_tx_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(batt_work, batt_work_handler);
+static K_WORK_DEFINE(batt_tx_work, batt_tx_work_handler);
+
+static atomic_t cached_pct = ATOMIC_INIT(-1);
+
+/* Written on the system work queue, read from the tracker and shell threads */
+static struct k_spinlock batt_lock;
+static struct at_battery_stats batt_stats;
+static uint32_t last_sample_ms;
+static uint32_t last_tx_ms;
+
+static uint8_t batt_mv_to_pct(int32_t mv)
+{
+	if (mv >= soc_table[0].mv) {
+		return soc_table[0].pct;
+	}
+
+	for (size_t i = 1; i < ARRAY_SIZE(soc_table); i++) {
+		if (mv >= soc_table[i].mv) {
+			int32_t span_mv = soc_table[i - 1].mv - soc_table[i].mv;
+			int32_t span_pct = soc_table[i - 1].pct - soc_table[i].pct;
+
+			return soc_table[i].pct + (mv - soc_table[i].mv) * span_pct / span_mv;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Read VBAT in mV. A sample right after TX only tracks the sag, the state of
+ * charge comes from rested samples alone since the sag would read low.
+ */
+static int batt_sample(bool tx)
+{
+	int16_t raw;
+	struct adc_sequence seq = {
+		.buffer = &raw,
+		.buffer_size = sizeof(raw),
+	};
+	int32_t mv;
+	int rc = adc_sequence_init_dt(&vbat, &seq);
+
+	if (rc == 0) {
+		rc = adc_read_dt(&vbat, &seq);
+	}
+	if (rc == 0) {
+		mv = raw;
+		rc = adc_raw_to_millivolts_dt(&vbat, &mv);
+	}
+	if (rc) {
+		K_SPINLOCK(&batt_lock) {
+			batt_stats.errors++;
+		}
+		LOG_ERR("VBAT read failed: %d", rc);
+		return rc;
+	}
+
+	// Undo the resistor divider in front of the ADC input
+	mv = mv * CONFIG_BATTERY_DIVIDER_X1000 / 1000;
+
+	uint8_t pct = batt_mv_to_pct(mv);
+
+	if (!tx) {
+		atomic_set(&cached_pct, pct);
+	}
+	K_SPINLOCK(&batt_lock) {
+		batt_stats.samples++;
+		if (tx) {
+			batt_stats.tx_samples++;
+		} else {
+			batt_stats.mv = mv;
+			batt_stats.pct = pct;
+		}
+		batt_stats.min_mv = batt_stats.min_mv ? MIN(batt_stats.min_mv, (uint32_t)mv) : mv;
+		last_sample_ms = k_uptime_get_32();
+	}
+
+	LOG_DBG("VBAT %d mV%s", mv, tx ? " after TX" : "");
+	return 0;
+}
+
+static void batt_work_handler(struct k_work *work)
+{
+	uint32_t since_tx = UINT32_MAX;
+
+	ARG_UNUSED(work);
+
+	K_SPINLOCK(&batt_lock) {
+		if (last_tx_ms != 0) {
+			since_tx = k_uptime_get_32() - last_tx_ms;
+		}
+	}
+	if (since_tx < BATT_REST_MS) {
+		// Still recovering from a TX, try again once it has rested
+		k_work_reschedule(&batt_work, K_MSEC(BATT_REST_MS - since_tx));
+		return;
+	}
+
+	(void)batt_sample(false);
+	k_work_reschedule(&batt_work, K_SECONDS(CONFIG_BATTERY_SAMPLE_S));
+}
+
+static void batt_tx_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	(void)batt_sample(true);
+}
+
+int init_at_battery(void)
+{
+	if (!adc_is_ready_dt(&vbat)) {
+		LOG_ERR("VBAT ADC not ready");
+		return -ENODEV;
+	}
+
+	int rc = adc_channel_setup_dt(&vbat);
+
+	if (rc) {
+		LOG_ERR("VBAT channel setup failed: %d", rc);
+		return rc;
+	}
+
+	// First sample now, then the slow cadence
+	k_work_reschedule(&batt_work, K_NO_WAIT);
+	return 0;
+}
+
+void at_battery_tx_done(void)
+{
+	bool sample = true;
+
+	K_SPINLOCK(&batt_lock) {
+		uint32_t now = k_uptime_get_32();
+
+		last_tx_ms = now;
+		if (last_sample_ms != 0 &&
+		    now - last_sample_ms < BATT_TX_SAMPLE_MIN_S * MSEC_PER_SEC) {
+			sample = false;
+		}
+	}
+	// Own work item, so the rested cadence of batt_work is not pushed back
+	if (sample) {
+		k_work_submit(&batt_tx_work);
+	}
+}
+
+void at_battery_stats_get(struct at_battery_stats *stats)
+{
+	K_SPINLOCK(&batt_lock) {
+		*stats = batt_stats;
+	}
+}
 
 int get_batt(struct at_sensors *sensors) {
-    //use hardcoded value until battery measurement possbile on HW
+	atomic_val_t pct = atomic_get(&cached_pct);
 
-    sensors->batt = 95;
+	// Cached, the ADC only runs on its own cadence and after TX
+	if (pct < 0) {
+		return -EAGAIN;
+	}
 
-    return 0; 
-}
\ No newline at end of file
+	sensors->batt = pct;
+	return 0;
+}
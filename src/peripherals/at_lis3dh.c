@@ -1,11 +1,17 @@
 // Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
 // SPDX-License-Identifier: MIT-0
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/drivers/sensor.h>
+#include <zephyr/drivers/i2c.h>
 
 #include "asset_tracker.h"
+#include "at_scheduler.h"
 #include "peripherals/at_lis3dh.h"
 
 #include <zephyr/logging/log.h>
@@ -21,19 +27,341 @@ LOG_MODULE_REGISTER(at_lis3dh, CONFIG_TRACKER_LOG_LEVEL);
 
 static const struct device *const acceld = DEVICE_DT_GET(DT_ALIAS(accel0));
 
+/* Wake-on-motion: data rate and samples above threshold for an activity interrupt */
+#if defined(CONFIG_ACCEL_FIFO)
+#define ACCEL_WAKE_ODR_HZ CONFIG_ACCEL_FIFO_ODR_HZ
+#else
+#define ACCEL_WAKE_ODR_HZ 10
+#endif
+#define ACCEL_WAKE_DUR_SAMPLES 1
+
+/* CTRL_REG2 HPIS2 - high-pass filter the INT2 any-motion comparator */
+#define ACCEL_HP_INT2 BIT(1)
+
+#if defined(CONFIG_ACCEL_FIFO)
+/*
+ * The Zephyr lis2dh driver has no FIFO support. The FIFO registers are
+ * programmed directly on the sensor's I2C address, and the driver's INT1
+ * data ready dispatch is reused to deliver the watermark interrupt.
+ */
+static const struct i2c_dt_spec accel_i2c = I2C_DT_SPEC_GET(DT_ALIAS(accel0));
+
+#define LIS3DH_CTRL_REG3 0x22
+#define LIS3DH_I1_WTM BIT(2)
+#define LIS3DH_CTRL_REG4 0x23
+#define LIS3DH_FS_SHIFT 4
+#define LIS3DH_FS_MASK (0x3 << LIS3DH_FS_SHIFT)
+#define LIS3DH_CTRL_REG5 0x24
+#define LIS3DH_FIFO_EN BIT(6)
+#define LIS3DH_OUT_X_L 0x28
+#define LIS3DH_AUTO_INC BIT(7)		// register address auto increment on I2C
+#define LIS3DH_FIFO_CTRL_REG 0x2E
+#define LIS3DH_FIFO_STREAM (0x2 << 6)
+#define LIS3DH_FIFO_SRC_REG 0x2F
+#define LIS3DH_FIFO_OVRN BIT(6)
+#define LIS3DH_FIFO_FSS_MASK 0x1F
+#define LIS3DH_FIFO_DEPTH 32
+
+/*
+ * Output registers are left justified, 12 bits in high resolution mode.
+ * Sensitivity per 12 bit LSB for each CTRL_REG4 full scale, +-16 g is not
+ * a power of two. Lower resolution modes only zero the low bits.
+ */
+static const uint8_t fifo_sens_mg[] = { 1, 2, 4, 12 };
+#define GRAVITY_MG 1000
+
+static K_MUTEX_DEFINE(fifo_lock);
+static struct at_accel_stats accel_stats;
+static uint8_t fifo_fs;		// full scale the driver configured, CTRL_REG4 FS
+static bool in_impact;
+static int32_t last_mg[3];
+
+/*
+ * Statistics of the samples drained since a window was last closed. The
+ * uplink scan and the background sampler each close their own, so neither
+ * cuts the other's short.
+ */
+enum accel_window {
+	WINDOW_UPLINK,
+	WINDOW_SAMPLE,
+	WINDOW_COUNT,
+};
+
+static struct accel_window_stats {
+	uint32_t count;
+	uint32_t peak_mg;
+	uint64_t dev_sq_sum;		// squared deviation from 1 g
+} windows[WINDOW_COUNT];
+#endif
+
+static uint32_t isqrt32(uint32_t n)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > n) {
+		bit >>= 2;
+	}
+	while (bit != 0) {
+		if (n >= root + bit) {
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
+
+
+#if defined(CONFIG_LIS2DH_TRIGGER)
+static void motion_trigger_handler(const struct device *dev, const struct sensor_trigger *trig)
+{
+	ARG_UNUSED(dev);
+	ARG_UNUSED(trig);
+
+	// Coalesced, a burst of interrupts while moving is a single event
+	at_event_send(MOTION_EVENT);
+}
+#endif
+
+int at_lis3dh_motion_config(uint8_t motion_thres)
+{
+#if defined(CONFIG_LIS2DH_TRIGGER)
+	struct sensor_trigger trig = {
+		.type = SENSOR_TRIG_DELTA,
+		.chan = SENSOR_CHAN_ACCEL_XYZ,
+	};
+	struct sensor_value odr = { .val1 = ACCEL_WAKE_ODR_HZ };
+	struct sensor_value dur = { .val1 = ACCEL_WAKE_DUR_SAMPLES };
+	struct sensor_value thres;
+	int rc;
+
+	sensor_ug_to_ms2((int32_t)motion_thres * MOTION_THRES_MG_PER_LSB * 1000, &thres);
+
+	rc = sensor_attr_set(acceld, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SAMPLING_FREQUENCY, &odr);
+#if defined(CONFIG_LIS2DH_ACCEL_HP_FILTERS)
+	// Compare the change in acceleration, not gravity
+	if (rc == 0) {
+		struct sensor_value hp = { .val1 = ACCEL_HP_INT2 };
+
+		rc = sensor_attr_set(acceld, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_CONFIGURATION, &hp);
+	}
+#endif
+	if (rc == 0) {
+		rc = sensor_attr_set(acceld, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SLOPE_TH, &thres);
+	}
+	if (rc == 0) {
+		rc = sensor_attr_set(acceld, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SLOPE_DUR, &dur);
+	}
+	if (rc == 0) {
+		rc = sensor_trigger_set(acceld, &trig, motion_trigger_handler);
+	}
+
+	if (rc) {
+		LOG_ERR("Activity interrupt setup failed: %d", rc);
+		return rc;
+	}
+
+	LOG_INF("Activity interrupt at %u mg, %u Hz", motion_thres * MOTION_THRES_MG_PER_LSB,
+		ACCEL_WAKE_ODR_HZ);
+	return 0;
+#else
+	ARG_UNUSED(motion_thres);
+	return -ENOTSUP;
+#endif
+}
+static uint32_t accel_magnitude(int32_t x_mg, int32_t y_mg, int32_t z_mg)
+{
+	// Each axis is within +-16 g so the sum fits 32 bits
+	return isqrt32((uint32_t)(x_mg * x_mg) + (uint32_t)(y_mg * y_mg) +
+		       (uint32_t)(z_mg * z_mg));
+}
+
+#if defined(CONFIG_ACCEL_FIFO)
+static void fifo_fold(const int32_t mg[3])
+{
+	uint32_t magnitude = accel_magnitude(mg[0], mg[1], mg[2]);
+	int32_t deviation = (int32_t)magnitude - GRAVITY_MG;
+	bool impact = abs(deviation) > CONFIG_ACCEL_IMPACT_MG;
+
+	for (int i = 0; i < ARRAY_SIZE(windows); i++) {
+		windows[i].count++;
+		windows[i].peak_mg = MAX(windows[i].peak_mg, magnitude);
+		windows[i].dev_sq_sum += (uint64_t)((int64_t)deviation * deviation);
+	}
+	// One impact per excursion above the threshold, not per sample
+	if (impact && !in_impact) {
+		accel_stats.impacts++;
+	}
+	in_impact = impact;
+	memcpy(last_mg, mg, sizeof(last_mg));
+}
+
+/* Read every sample waiting in the FIFO in one burst, call with fifo_lock held */
+static int fifo_drain(void)
+{
+	uint8_t buf[LIS3DH_FIFO_DEPTH * 6];
+	uint8_t src;
+	int rc = i2c_reg_read_byte_dt(&accel_i2c, LIS3DH_FIFO_SRC_REG, &src);
+
+	if (rc) {
+		return rc;
+	}
+
+	uint8_t count = (src & LIS3DH_FIFO_OVRN) ? LIS3DH_FIFO_DEPTH : (src & LIS3DH_FIFO_FSS_MASK);
+
+	if (src & LIS3DH_FIFO_OVRN) {
+		accel_stats.overruns++;
+	}
+	if (count == 0) {
+		return 0;
+	}
+
+	rc = i2c_burst_read_dt(&accel_i2c, LIS3DH_OUT_X_L | LIS3DH_AUTO_INC, buf, count * 6);
+	if (rc) {
+		return rc;
+	}
+
+	for (uint8_t i = 0; i < count; i++) {
+		int32_t mg[3];
+
+		for (int axis = 0; axis < 3; axis++) {
+			int16_t raw = (int16_t)sys_get_le16(&buf[i * 6 + axis * 2]);
+
+			mg[axis] = (int32_t)(raw >> 4) * fifo_sens_mg[fifo_fs];
+		}
+		fifo_fold(mg);
+	}
+
+	accel_stats.fifo_reads++;
+	accel_stats.samples += count;
+	return 0;
+}
+
+static void fifo_wtm_handler(const struct device *dev, const struct sensor_trigger *trig)
+{
+	ARG_UNUSED(dev);
+	ARG_UNUSED(trig);
+
+	k_mutex_lock(&fifo_lock, K_FOREVER);
+	if (fifo_drain()) {
+		LOG_ERR("FIFO drain failed");
+	}
+	k_mutex_unlock(&fifo_lock);
+}
+
+static int fifo_init(void)
+{
+	struct sensor_trigger trig = {
+		.type = SENSOR_TRIG_DATA_READY,
+		.chan = SENSOR_CHAN_ACCEL_XYZ,
+	};
+	struct sensor_value odr = { .val1 = CONFIG_ACCEL_FIFO_ODR_HZ };
+	uint8_t ctrl4;
+	int rc = sensor_attr_set(acceld, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SAMPLING_FREQUENCY,
+				 &odr);
+
+	// Scale the raw samples by whatever range the driver set up
+	if (rc == 0) {
+		rc = i2c_reg_read_byte_dt(&accel_i2c, LIS3DH_CTRL_REG4, &ctrl4);
+		fifo_fs = (ctrl4 & LIS3DH_FS_MASK) >> LIS3DH_FS_SHIFT;
+	}
+
+	// Let the driver own the INT1 line, then route the watermark to it
+	if (rc == 0) {
+		rc = sensor_trigger_set(acceld, &trig, fifo_wtm_handler);
+	}
+	if (rc == 0) {
+		rc = i2c_reg_update_byte_dt(&accel_i2c, LIS3DH_CTRL_REG5, LIS3DH_FIFO_EN,
+					    LIS3DH_FIFO_EN);
+	}
+	if (rc == 0) {
+		rc = i2c_reg_write_byte_dt(&accel_i2c, LIS3DH_FIFO_CTRL_REG,
+					   LIS3DH_FIFO_STREAM | CONFIG_ACCEL_FIFO_WTM);
+	}
+	if (rc == 0) {
+		rc = i2c_reg_write_byte_dt(&accel_i2c, LIS3DH_CTRL_REG3, LIS3DH_I1_WTM);
+	}
+
+	if (rc) {
+		LOG_ERR("FIFO setup failed: %d", rc);
+		return rc;
+	}
+
+	LOG_INF("FIFO streaming at %u Hz, +-%u g, wakeup every %u samples",
+		CONFIG_ACCEL_FIFO_ODR_HZ, 2 << fifo_fs, CONFIG_ACCEL_FIFO_WTM);
+	return 0;
+}
+
+/* Latest sample and window peak from the FIFO, then start a new window */
+static int get_accel_fifo(struct at_sensors *sensors, enum accel_window id)
+{
+	struct accel_window_stats *window = &windows[id];
+	uint32_t rms_mg = 0;
+
+	k_mutex_lock(&fifo_lock, K_FOREVER);
+
+	int rc = fifo_drain();
+
+	sensors->accel_x_mg = last_mg[0];
+	sensors->accel_y_mg = last_mg[1];
+	sensors->accel_z_mg = last_mg[2];
+	sensors->peak_accel_mg = window->peak_mg;
+
+	if (window->count > 0) {
+		rms_mg = isqrt32((uint32_t)(window->dev_sq_sum / window->count));
+	}
+	// The stats report the uplink window
+	if (id == WINDOW_UPLINK && window->count > 0) {
+		accel_stats.window_samples = window->count;
+		accel_stats.peak_mg = window->peak_mg;
+		accel_stats.rms_mg = rms_mg;
+	}
+	*window = (struct accel_window_stats){ 0 };
+
+	k_mutex_unlock(&fifo_lock);
+
+	if (rc) {
+		LOG_ERR("FIFO drain failed: %d", rc);
+	} else {
+		LOG_INF("x %d , y %d , z %d mg, peak %u mg, rms %u mg",
+			sensors->accel_x_mg, sensors->accel_y_mg, sensors->accel_z_mg,
+			sensors->peak_accel_mg, rms_mg);
+	}
+	// Samples drained earlier still make a valid window
+	return 0;
+}
+#endif
+
+void at_lis3dh_stats_get(struct at_accel_stats *stats)
+{
+#if defined(CONFIG_ACCEL_FIFO)
+	k_mutex_lock(&fifo_lock, K_FOREVER);
+	*stats = accel_stats;
+	k_mutex_unlock(&fifo_lock);
+#else
+	*stats = (struct at_accel_stats){ 0 };
+#endif
+}
 
 int init_at_lis3dh(void) {
 	
 	if (!device_is_ready(acceld)) {
 		LOG_ERR("LIS3DH device not ready.");
 		return -1;
-   	} else {
-		return 0;
-	}
+   	}
+#if defined(CONFIG_ACCEL_FIFO)
+	return fifo_init();
+#else
+	return 0;
+#endif
 }
 
-int get_accel(struct at_sensors *sensors) {
-
+#if !defined(CONFIG_ACCEL_FIFO)
+static int get_accel_polled(struct at_sensors *sensors)
+{
 	struct sensor_value accel[3];
 	const char *overrun = "";
 	int rc = sensor_sample_fetch(acceld);
@@ -50,30 +378,42 @@ int get_accel(struct at_sensors *sensors) {
 					SENSOR_CHAN_ACCEL_XYZ,
 					accel);
 	}
-
-	sensors->max_accel_x = sensor_value_to_double(&accel[0]);
-	sensors->max_accel_y = sensor_value_to_double(&accel[1]);
-	sensors->max_accel_z = sensor_value_to_double(&accel[2]);
-
-	//find the max of the three
-	sensors->peak_accel = sensors->max_accel_x;
-	if(sensors->peak_accel < sensors->max_accel_y) {
-		sensors->peak_accel = sensors->max_accel_y;
-	}
-	if(sensors->peak_accel < sensors->max_accel_z) {
-		sensors->peak_accel = sensors->max_accel_z;
-	}
-
 	if (rc < 0) {
 		LOG_ERR("ERROR: Update failed: %d", rc);
-	} else {
-		LOG_INF("%sx %f , y %f , z %f",
-		       overrun,
-		       sensors->max_accel_x,
-		       sensors->max_accel_y,
-		       sensors->max_accel_z);
+		return rc;
 	}
 
+	sensors->accel_x_mg = sensor_ms2_to_mg(&accel[0]);
+	sensors->accel_y_mg = sensor_ms2_to_mg(&accel[1]);
+	sensors->accel_z_mg = sensor_ms2_to_mg(&accel[2]);
+
+	sensors->peak_accel_mg = accel_magnitude(sensors->accel_x_mg, sensors->accel_y_mg,
+						 sensors->accel_z_mg);
+
+	LOG_INF("%sx %d , y %d , z %d mg, |a| %u mg",
+	       overrun,
+	       sensors->accel_x_mg,
+	       sensors->accel_y_mg,
+	       sensors->accel_z_mg,
+	       sensors->peak_accel_mg);
 	return 0;
+}
+#endif
+
+int get_accel(struct at_sensors *sensors) {
+
+#if defined(CONFIG_ACCEL_FIFO)
+	return get_accel_fifo(sensors, WINDOW_UPLINK);
+#else
+	return get_accel_polled(sensors);
+#endif
+}
 
-}
\ No newline at end of file
+int get_accel_sample(struct at_sensors *sensors)
+{
+#if defined(CONFIG_ACCEL_FIFO)
+	return get_accel_fifo(sensors, WINDOW_SAMPLE);
+#else
+	return get_accel_polled(sensors);
+#endif
+}
@@ -0,0 +1,162 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+#include "asset_tracker.h"
+#include "peripherals/at_battery.h"
+#include "peripherals/at_lis3dh.h"
+#include "peripherals/at_sensors.h"
+#include "peripherals/at_sht41.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(at_sensors, CONFIG_TRACKER_LOG_LEVEL);
+
+/*
+ * Sensor reads block on I2C (the SHT41 high repeatability conversion alone
+ * takes several ms), so they run here instead of on the Sidewalk thread.
+ */
+static struct k_work_q sensor_wq;
+K_THREAD_STACK_DEFINE(sensor_wq_stack, SENSOR_WQ_STACK_SIZE);
+
+static void sensor_work_handler(struct k_work *work);
+K_WORK_DEFINE(sensor_work, sensor_work_handler);
+
+/* Double buffer - the work handler fills the back buffer, then flips */
+static struct at_sensors snapshot[2];
+static uint8_t front;
+static struct k_spinlock snapshot_lock;
+
+#if CONFIG_SENSOR_SAMPLE_S > 0
+static void sample_work_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(sample_work, sample_work_handler);
+#endif
+
+/* Aggregation window, fixed size so it never allocates */
+static struct {
+	uint32_t count;
+	uint32_t start_ms;
+	int32_t temp_min_mc;
+	int32_t temp_max_mc;
+	int64_t temp_sum_mc;
+	int32_t hum_min_mpct;
+	int32_t hum_max_mpct;
+	int64_t hum_sum_mpct;
+	uint32_t accel_max_mg;
+	uint64_t accel_sum_mg;
+} agg;
+static struct k_spinlock agg_lock;
+
+static void agg_add(const struct at_sensors *sample)
+{
+	K_SPINLOCK(&agg_lock) {
+		if (agg.count == 0) {
+			agg.temp_min_mc = agg.temp_max_mc = sample->temp_mc;
+			agg.hum_min_mpct = agg.hum_max_mpct = sample->hum_mpct;
+		}
+		agg.count++;
+		agg.temp_min_mc = MIN(agg.temp_min_mc, sample->temp_mc);
+		agg.temp_max_mc = MAX(agg.temp_max_mc, sample->temp_mc);
+		agg.temp_sum_mc += sample->temp_mc;
+		agg.hum_min_mpct = MIN(agg.hum_min_mpct, sample->hum_mpct);
+		agg.hum_max_mpct = MAX(agg.hum_max_mpct, sample->hum_mpct);
+		agg.hum_sum_mpct += sample->hum_mpct;
+		agg.accel_max_mg = MAX(agg.accel_max_mg, sample->peak_accel_mg);
+		agg.accel_sum_mg += sample->peak_accel_mg;
+	}
+}
+
+static void sensor_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	struct at_sensors *back = &snapshot[!front];
+	int temp_err, accel_err;
+
+	LOG_INF("Scanning sensors...");
+	temp_err = get_temp_hum(back);
+	accel_err = get_accel(back);
+	get_batt(back);
+	// A failed read leaves stale values behind, keep them out of the window
+	if (temp_err == 0 && accel_err == 0) {
+		agg_add(back);
+	}
+
+	K_SPINLOCK(&snapshot_lock) {
+		front = !front;
+	}
+
+	at_event_send(EVENT_SENSORS_READY);
+}
+
+#if CONFIG_SENSOR_SAMPLE_S > 0
+/* Background sample between uplinks, only feeds the aggregation window */
+static void sample_work_handler(struct k_work *work)
+{
+	struct at_sensors sample = { 0 };
+
+	if (get_temp_hum(&sample) == 0 && get_accel_sample(&sample) == 0) {
+		agg_add(&sample);
+	}
+	k_work_reschedule_for_queue(&sensor_wq, &sample_work, K_SECONDS(CONFIG_SENSOR_SAMPLE_S));
+}
+#endif
+
+int init_at_sensors(void)
+{
+	k_work_queue_init(&sensor_wq);
+	k_work_queue_start(&sensor_wq, sensor_wq_stack, K_THREAD_STACK_SIZEOF(sensor_wq_stack),
+			   SENSOR_WQ_PRIORITY, NULL);
+	k_thread_name_set(&sensor_wq.thread, "at_sensor_wq");
+
+	agg.start_ms = k_uptime_get_32();
+#if CONFIG_SENSOR_SAMPLE_S > 0
+	k_work_schedule_for_queue(&sensor_wq, &sample_work, K_SECONDS(CONFIG_SENSOR_SAMPLE_S));
+#endif
+	return 0;
+}
+
+int at_sensors_request(void)
+{
+	int ret = k_work_submit_to_queue(&sensor_wq, &sensor_work);
+
+	if (ret < 0) {
+		LOG_ERR("Failed to queue sensor scan: %d", ret);
+		return ret;
+	}
+	return 0;
+}
+
+void at_sensors_get(struct at_sensors *sensors)
+{
+	K_SPINLOCK(&snapshot_lock) {
+		*sensors = snapshot[front];
+	}
+}
+
+uint32_t at_sensors_agg_take(struct at_sensor_agg *out)
+{
+	uint32_t now = k_uptime_get_32();
+
+	K_SPINLOCK(&agg_lock) {
+		*out = (struct at_sensor_agg){
+			.count = agg.count,
+			.window_ms = now - agg.start_ms,
+			.temp_min_mc = agg.temp_min_mc,
+			.temp_max_mc = agg.temp_max_mc,
+			.hum_min_mpct = agg.hum_min_mpct,
+			.hum_max_mpct = agg.hum_max_mpct,
+			.accel_max_mg = agg.accel_max_mg,
+		};
+		if (agg.count > 0) {
+			out->temp_mean_mc = agg.temp_sum_mc / agg.count;
+			out->hum_mean_mpct = agg.hum_sum_mpct / agg.count;
+			out->accel_mean_mg = agg.accel_sum_mg / agg.count;
+		}
+		memset(&agg, 0, sizeof(agg));
+		agg.start_ms = now;
+	}
+	return out->count;
+}
@@ -45,10 +45,10 @@ int get_temp_hum(struct at_sensors *sensors) {
 	sensor_channel_get(th_sensor, SENSOR_CHAN_HUMIDITY, &hum);
 
 
-	sensors->temp = sensor_value_to_double(&temp);
-	sensors->hum = sensor_value_to_double(&hum);
+	sensors->temp_mc = (int32_t)sensor_value_to_milli(&temp);
+	sensors->hum_mpct = (int32_t)sensor_value_to_milli(&hum);
 
-	LOG_INF("SHT4X: %.2f Temp. [C] ; %0.2f RH [%%]", sensors->temp, sensors->hum); 
+	LOG_INF("SHT4X: %d mC Temp. ; %d m%% RH", sensors->temp_mc, sensors->hum_mpct); 
 
 	return 0;
 }
\ No newline at end of file
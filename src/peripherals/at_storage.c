@@ -1,5 +1,363 @@
 // Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
 // SPDX-License-Identifier: MIT-0
 
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#if defined(CONFIG_PARTITION_MANAGER_ENABLED)
+#include <pm_config.h>
+#endif
+
+#include "peripherals/at_storage.h"
+
 #include <zephyr/logging/log.h>
-LOG_MODULE_REGISTER(at_storage, CONFIG_TRACKER_LOG_LEVEL);
\ No newline at end of file
+LOG_MODULE_REGISTER(at_storage, CONFIG_TRACKER_LOG_LEVEL);
+
+/*
+ * Store-and-forward telemetry log in the telemetry_log partition, on the
+ * external QSPI NOR on the tracker. The tracker takes it from the Partition
+ * Manager (pm_static), tests without it from the telemetry_log_partition
+ * fixed partition.
+ *
+ * The region is a ring of fixed size records, appended in order. A record is
+ * committed once its CRC matches, so a write cut short by a reset is simply
+ * skipped. Every slot takes the next sequence number, written or not, so the
+ * slots from tail to head hold consecutive numbers. Delivered records are
+ * marked by programming their sent word to 0, which NOR allows without an
+ * erase. A sector is erased only when the head wraps into it, dropping
+ * whatever was still pending there.
+ */
+#if defined(CONFIG_PARTITION_MANAGER_ENABLED)
+#define LOG_OFFSET PM_TELEMETRY_LOG_ADDRESS
+#define LOG_SIZE PM_TELEMETRY_LOG_SIZE
+#define LOG_DEVICE DEVICE_DT_GET(DT_CHOSEN(nordic_pm_ext_flash))
+#else
+#define LOG_OFFSET FIXED_PARTITION_OFFSET(telemetry_log_partition)
+#define LOG_SIZE FIXED_PARTITION_SIZE(telemetry_log_partition)
+#define LOG_DEVICE FIXED_PARTITION_DEVICE(telemetry_log_partition)
+#endif
+#define LOG_RECORD_SIZE 32
+#define LOG_SECTOR_SIZE 4096		// p25q32sh erase sector
+#define LOG_RECORDS_PER_SECTOR (LOG_SECTOR_SIZE / LOG_RECORD_SIZE)
+#define LOG_SECTORS (LOG_SIZE / LOG_SECTOR_SIZE)
+#define LOG_RECORDS (LOG_SECTORS * LOG_RECORDS_PER_SECTOR)
+
+#define LOG_MAGIC 0x544c		// "TL"
+#define LOG_TYPE_TELEMETRY 0x01
+#define LOG_ERASED 0xFFFFFFFF
+
+struct log_record {
+	uint32_t seq;
+	uint16_t magic;
+	uint8_t type;
+	uint8_t len;
+	uint8_t data[16];
+	uint32_t crc;			// crc32 over all fields above
+	uint32_t sent;			// LOG_ERASED while pending
+};
+
+BUILD_ASSERT(sizeof(struct log_record) == LOG_RECORD_SIZE);
+BUILD_ASSERT(sizeof(struct telemetry_sample) <= sizeof(((struct log_record *)0)->data));
+BUILD_ASSERT(LOG_SECTORS >= 2, "Telemetry log needs at least two sectors");
+BUILD_ASSERT(LOG_OFFSET % LOG_SECTOR_SIZE == 0 && LOG_SIZE % LOG_SECTOR_SIZE == 0,
+	     "Telemetry log must be aligned to erase sectors");
+
+enum slot_state {
+	SLOT_ERASED,
+	SLOT_PENDING,
+	SLOT_SENT,
+	SLOT_INVALID,
+};
+
+static const struct device *flash_dev = LOG_DEVICE;
+
+static K_MUTEX_DEFINE(log_lock);
+static bool log_ready;
+
+static uint32_t head;			// next slot to write
+static uint32_t tail;			// oldest slot that may be pending
+static uint32_t next_seq;
+static uint32_t tail_seq;		// seq of the oldest pending record
+static uint32_t peek_time;
+static struct at_storage_stats stats;
+
+static off_t slot_offset(uint32_t slot)
+{
+	return LOG_OFFSET + (off_t)slot * LOG_RECORD_SIZE;
+}
+
+static uint32_t record_crc(const struct log_record *rec)
+{
+	return crc32_ieee((const uint8_t *)rec, offsetof(struct log_record, crc));
+}
+
+static enum slot_state read_slot(uint32_t slot, struct log_record *rec)
+{
+	static const uint8_t erased[LOG_RECORD_SIZE] = { [0 ... LOG_RECORD_SIZE - 1] = 0xFF };
+
+	if (flash_read(flash_dev, slot_offset(slot), rec, sizeof(*rec))) {
+		return SLOT_INVALID;
+	}
+	if (memcmp(rec, erased, sizeof(*rec)) == 0) {
+		return SLOT_ERASED;
+	}
+	if (rec->magic != LOG_MAGIC || rec->crc != record_crc(rec)) {
+		return SLOT_INVALID;
+	}
+	return (rec->sent == LOG_ERASED) ? SLOT_PENDING : SLOT_SENT;
+}
+
+static uint32_t backlog(void)
+{
+	return next_seq - tail_seq;
+}
+
+/**
+ * Move the tail to the first pending record of the remaining slots from slot
+ * on, or to the head. Counting slots keeps a full ring, where the head has
+ * caught up with the tail, apart from an empty one.
+ */
+static void seek_tail(uint32_t slot, uint32_t remaining)
+{
+	struct log_record rec;
+
+	tail = slot;
+	tail_seq = next_seq - remaining;
+	for (; remaining > 0; remaining--) {
+		if (read_slot(tail, &rec) == SLOT_PENDING) {
+			return;
+		}
+		tail = (tail + 1) % LOG_RECORDS;
+		tail_seq++;
+	}
+}
+
+/**
+ * Rebuild head and tail from the flash contents
+ */
+static void log_recover(void)
+{
+	struct log_record rec;
+	uint32_t head_sector = 0;
+	bool found = false;
+
+	// The head sector holds the highest sequence number in a first slot
+	for (uint32_t s = 0; s < LOG_SECTORS; s++) {
+		enum slot_state state = read_slot(s * LOG_RECORDS_PER_SECTOR, &rec);
+
+		if (state != SLOT_PENDING && state != SLOT_SENT) {
+			continue;
+		}
+		if (!found || (int32_t)(rec.seq - next_seq) >= 0) {
+			head_sector = s;
+			next_seq = rec.seq;
+			found = true;
+		}
+	}
+
+	if (!found) {
+		head = 0;
+		tail = 0;
+		next_seq = 0;
+		tail_seq = 0;
+		return;
+	}
+
+	// Head goes after the last used slot of that sector
+	head = (head_sector + 1) * LOG_RECORDS_PER_SECTOR;
+	for (uint32_t i = 0; i < LOG_RECORDS_PER_SECTOR; i++) {
+		uint32_t slot = head_sector * LOG_RECORDS_PER_SECTOR + i;
+		enum slot_state state = read_slot(slot, &rec);
+
+		if (state == SLOT_ERASED) {
+			head = slot;
+			break;
+		}
+		if (state == SLOT_INVALID) {
+			// The torn record took its sequence number with it
+			stats.torn++;
+			next_seq++;
+		} else {
+			next_seq = rec.seq + 1;
+		}
+	}
+	head %= LOG_RECORDS;
+
+	// Oldest data starts in the sector after the head sector. Sectors whose
+	// last record is already sent were fully drained and are skipped.
+	for (uint32_t i = 1; i <= LOG_SECTORS; i++) {
+		uint32_t s = (head_sector + i) % LOG_SECTORS;
+		uint32_t first = s * LOG_RECORDS_PER_SECTOR;
+
+		if (s != head_sector &&
+		    (read_slot(first, &rec) == SLOT_ERASED ||
+		     read_slot(first + LOG_RECORDS_PER_SECTOR - 1, &rec) == SLOT_SENT)) {
+			continue;
+		}
+		// Slots from here up to the head, all of them when the ring is full
+		seek_tail(first, (head - first + LOG_RECORDS - 1) % LOG_RECORDS + 1);
+		return;
+	}
+}
+
+int init_at_storage(void)
+{
+	if (!device_is_ready(flash_dev)) {
+		LOG_ERR("Telemetry log flash not ready");
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&log_lock, K_FOREVER);
+	log_recover();
+	stats.capacity = LOG_RECORDS;
+	stats.backlog = backlog();
+	log_ready = true;
+	k_mutex_unlock(&log_lock);
+
+	LOG_INF("Telemetry log: %u records pending, head %u, tail %u, %u torn", stats.backlog,
+		head, tail, stats.torn);
+	return 0;
+}
+
+int at_storage_append(const struct telemetry_sample *sample)
+{
+	struct log_record rec = {
+		.magic = LOG_MAGIC,
+		.type = LOG_TYPE_TELEMETRY,
+		.len = sizeof(*sample),
+		.sent = LOG_ERASED,
+	};
+	int err;
+
+	if (!log_ready) {
+		return -ENODEV;
+	}
+
+	memset(rec.data, 0xFF, sizeof(rec.data));
+	memcpy(rec.data, sample, sizeof(*sample));
+
+	k_mutex_lock(&log_lock, K_FOREVER);
+
+	if (head % LOG_RECORDS_PER_SECTOR == 0) {
+		uint32_t sector_end = head + LOG_RECORDS_PER_SECTOR;
+
+		err = flash_erase(flash_dev, slot_offset(head), LOG_SECTOR_SIZE);
+		if (err) {
+			LOG_ERR("Telemetry log erase failed: %d", err);
+			goto out;
+		}
+		// Anything still pending in this sector is gone. Slots after the tail
+		// hold consecutive sequence numbers, so the survivors start at the
+		// next sector without reading it back.
+		if (backlog() > 0 && tail >= head && tail < sector_end) {
+			uint32_t lost = MIN(sector_end - tail, backlog());
+
+			tail = sector_end % LOG_RECORDS;
+			tail_seq += lost;
+			stats.overwritten += lost;
+			LOG_WRN("Telemetry log full, dropped %u oldest records", lost);
+		}
+	}
+
+	if (backlog() == 0) {
+		tail = head;
+		tail_seq = next_seq;
+	}
+	rec.seq = next_seq;
+	rec.crc = record_crc(&rec);
+	err = flash_write(flash_dev, slot_offset(head), &rec, sizeof(rec));
+
+	// A failed write still takes its slot, whatever made it to flash fails
+	// the CRC and is skipped
+	head = (head + 1) % LOG_RECORDS;
+	next_seq++;
+	if (err) {
+		LOG_ERR("Telemetry log write failed: %d", err);
+		goto out;
+	}
+	stats.appended++;
+
+out:
+	stats.backlog = backlog();
+	k_mutex_unlock(&log_lock);
+	return err;
+}
+
+int at_storage_peek(struct telemetry_sample *samples, size_t max)
+{
+	struct log_record rec;
+	size_t count = 0;
+	uint32_t slot;
+
+	if (!log_ready) {
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&log_lock, K_FOREVER);
+	slot = tail;
+	for (uint32_t n = backlog(); n > 0 && count < max; n--, slot = (slot + 1) % LOG_RECORDS) {
+		if (read_slot(slot, &rec) == SLOT_PENDING) {
+			memcpy(&samples[count++], rec.data, sizeof(*samples));
+		} else if (count == 0) {
+			// Step over torn slots at the tail so they do not count as backlog
+			tail = (slot + 1) % LOG_RECORDS;
+			tail_seq++;
+		}
+	}
+	stats.backlog = backlog();
+	peek_time = k_uptime_get_32();
+	k_mutex_unlock(&log_lock);
+
+	return count;
+}
+
+int at_storage_consume(size_t count)
+{
+	uint32_t sent = 0;
+	struct log_record rec;
+	uint32_t slot;
+	uint32_t n;
+	int err = 0;
+
+	if (!log_ready) {
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&log_lock, K_FOREVER);
+	slot = tail;
+	for (n = backlog(); n > 0 && count > 0; n--, slot = (slot + 1) % LOG_RECORDS) {
+		if (read_slot(slot, &rec) != SLOT_PENDING) {
+			continue;
+		}
+		err = flash_write(flash_dev, slot_offset(slot) + offsetof(struct log_record, sent),
+				  &sent, sizeof(sent));
+		if (err) {
+			LOG_ERR("Telemetry log consume failed: %d", err);
+			break;
+		}
+		count--;
+		stats.drained++;
+	}
+	seek_tail(slot, n);
+	stats.drain_ms += k_uptime_get_32() - peek_time;
+	stats.backlog = backlog();
+	k_mutex_unlock(&log_lock);
+
+	return err;
+}
+
+uint32_t at_storage_backlog(void)
+{
+	return stats.backlog;
+}
+
+void at_storage_stats_get(struct at_storage_stats *out)
+{
+	k_mutex_lock(&log_lock, K_FOREVER);
+	*out = stats;
+	k_mutex_unlock(&log_lock);
+}
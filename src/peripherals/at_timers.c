@@ -5,6 +5,7 @@
 #include "peripherals/at_button.h"
 #include "peripherals/at_led.h"
 #include "asset_tracker.h"
+#include "at_scheduler.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(at_timers, CONFIG_TRACKER_LOG_LEVEL);
@@ -12,10 +13,20 @@ LOG_MODULE_REGISTER(at_timers, CONFIG_TRACKER_LOG_LEVEL);
 static void scan_timer_cb(struct k_timer *timer_id);
 static void ble_conn_timer_cb(struct k_timer *timer_id);
 static void btn_press_timer_cb(struct k_timer *timer_id);
+static void cycle_timer_cb(struct k_timer *timer_id);
+static void uplink_retry_timer_cb(struct k_timer *timer_id);
+static void storage_drain_timer_cb(struct k_timer *timer_id);
+static void ble_l1_timer_cb(struct k_timer *timer_id);
+static void restore_retry_timer_cb(struct k_timer *timer_id);
 
 K_TIMER_DEFINE(scan_timer, scan_timer_cb, NULL);
 K_TIMER_DEFINE(ble_conn_timer, ble_conn_timer_cb, NULL);
 K_TIMER_DEFINE(btn_press_timer, btn_press_timer_cb, NULL);
+K_TIMER_DEFINE(cycle_timer, cycle_timer_cb, NULL);
+K_TIMER_DEFINE(uplink_retry_timer, uplink_retry_timer_cb, NULL);
+K_TIMER_DEFINE(storage_drain_timer, storage_drain_timer_cb, NULL);
+K_TIMER_DEFINE(ble_l1_timer, ble_l1_timer_cb, NULL);
+K_TIMER_DEFINE(restore_retry_timer, restore_retry_timer_cb, NULL);
 
 bool ble_timeout = false;
 
@@ -30,11 +41,12 @@ static void scan_timer_cb(struct k_timer *timer_id)
 	at_event_send(EVENT_SCAN_SENSORS);
 	
 	// Trigger location scan (WiFi/GNSS for LoRa, or gateway location for BLE)
-	// The location callback will then trigger EVENT_SEND_UPLINK when complete
+	// once the sensor snapshot is ready. Telemetry is queued as soon as the
+	// location scan is done, while its fragments are still being sent
 	at_event_send(EVENT_SCAN_LOC);
 
-	//reload scan timer
-    scan_timer_set_and_run(K_SECONDS(CONFIG_MOTION_SCAN_PER_S)); 
+	//reload scan timer with the motion or static cadence
+	scan_timer_set_and_run(at_scheduler_next());
 
 }
 
@@ -42,6 +54,8 @@ static void ble_conn_timer_cb(struct k_timer *timer_id) {
 	ARG_UNUSED(timer_id);
 	ble_timeout = true;
 	LOG_WRN("BLE connection timeout... uplink failed.");
+	// Wake the asset tracker thread blocked in EVENT_BLE_CONNECTION_WAIT
+	at_event_send(EVENT_BLE_CONNECTION_WAIT);
 
 }
 
@@ -61,11 +75,103 @@ static void btn_press_timer_cb(struct k_timer *timer_id)
 	LOG_INF("Long button press...");
 }
 
+static void cycle_timer_cb(struct k_timer *timer_id)
+{
+	ARG_UNUSED(timer_id);
+	LOG_WRN("Scan cycle timeout");
+	at_event_send(EVENT_CYCLE_TIMEOUT);
+}
+
+void cycle_timer_set_and_run(void)
+{
+	k_timer_start(&cycle_timer, K_SECONDS(CONFIG_CYCLE_TIMEOUT_S), Z_TIMEOUT_NO_WAIT);
+}
+
+void cycle_timer_stop(void)
+{
+	k_timer_stop(&cycle_timer);
+}
+
+static void uplink_retry_timer_cb(struct k_timer *timer_id)
+{
+	ARG_UNUSED(timer_id);
+	at_event_send(EVENT_UPLINK_RETRY);
+}
+
+void uplink_retry_timer_set_and_run(k_timeout_t delay)
+{
+	k_timer_start(&uplink_retry_timer, delay, Z_TIMEOUT_NO_WAIT);
+}
+
+void uplink_retry_timer_stop(void)
+{
+	k_timer_stop(&uplink_retry_timer);
+}
+
+static void storage_drain_timer_cb(struct k_timer *timer_id)
+{
+	ARG_UNUSED(timer_id);
+	at_event_send(EVENT_STORAGE_DRAIN);
+}
+
+void storage_drain_timer_set_and_run(k_timeout_t delay)
+{
+	// A drain already due goes first, it is not pushed back
+	if (k_timer_remaining_get(&storage_drain_timer) == 0) {
+		k_timer_start(&storage_drain_timer, delay, Z_TIMEOUT_NO_WAIT);
+	}
+}
+
+static void ble_l1_timer_cb(struct k_timer *timer_id)
+{
+	ARG_UNUSED(timer_id);
+	LOG_WRN("BLE L1 timeout");
+	at_event_send(EVENT_BLE_L1_TIMEOUT);
+}
+
+/* Deadline of the BLE_L1 and RESTORING states, one of them at a time */
+void ble_l1_timer_set_and_run(k_timeout_t delay)
+{
+	k_timer_start(&ble_l1_timer, delay, Z_TIMEOUT_NO_WAIT);
+}
+
+void ble_l1_timer_stop(void)
+{
+	k_timer_stop(&ble_l1_timer);
+}
+
+/* False for a timeout queued before the timer was re-armed for the next state */
+bool ble_l1_timer_expired(void)
+{
+	return k_timer_remaining_get(&ble_l1_timer) == 0;
+}
+
+static void restore_retry_timer_cb(struct k_timer *timer_id)
+{
+	ARG_UNUSED(timer_id);
+	at_event_send(EVENT_RESTORE_FULL_STACK);
+}
+
+void restore_retry_timer_set_and_run(void)
+{
+	k_timer_start(&restore_retry_timer, K_SECONDS(CONFIG_RESTORE_RETRY_S), Z_TIMEOUT_NO_WAIT);
+}
+
+void restore_retry_timer_stop(void)
+{
+	k_timer_stop(&restore_retry_timer);
+}
+
 void scan_timer_set_and_run(k_timeout_t delay)
 {
 	k_timer_start(&scan_timer, delay, Z_TIMEOUT_NO_WAIT);
 }
 
+uint32_t scan_timer_remaining_ms(void)
+{
+	return k_timer_remaining_get(&scan_timer);
+}
+
 void btn_press_timer_set_and_run(void)
 {
 	button_long_press = false;
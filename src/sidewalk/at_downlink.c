@@ -1,33 +1,230 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
 
-//TO DO - implement CONFIG downlink messages
+#include <errno.h>
 
-// #include <sid_api.h>
-// #include <sid_error.h>
-// #include <zephyr/kernel.h>
-// #include <zephyr/logging/log.h>
-// LOG_MODULE_REGISTER(at_downlink, CONFIG_TRACKER_LOG_LEVEL);
+#include <sid_api.h>
+#include <sid_error.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(at_downlink, CONFIG_TRACKER_LOG_LEVEL);
 
-// #include <asset_tracker.h>
-// #include <sidewalk/at_downlink.h>
+#include <asset_tracker.h>
+#include <sidewalk/at_downlink.h>
+#include "at_config.h"
 
+K_MSGQ_DEFINE(at_rx_task_msgq, sizeof(struct at_rx_msg), RECEIVE_TASK_QUEUE_SIZE, 4);
 
+static struct k_thread at_rx_thread;
+K_THREAD_STACK_DEFINE(at_rx_thread_stack, RECEIVE_TASK_STACK_SIZE);
 
-// static void at_rx_task(void *ctx, void *unused, void *unused2)
-// {
-// 	// at_ctx_t *at_ctx = (at_ctx_t *)ctx;
-// 	ARG_UNUSED(ctx);
-// 	ARG_UNUSED(unused);
-// 	ARG_UNUSED(unused2);
+/**
+ * Downlink decoder entry, the payload length includes the opcode byte
+ */
+struct dl_command {
+	uint8_t opcode;
+	uint8_t min_len;
+	uint8_t max_len;
+	const char *name;
+	int (*handler)(at_ctx_t *at_ctx, const uint8_t *payload, size_t len);
+};
 
-// 	LOG_DBG("Starting %s ...", __FUNCTION__);
+/* Written by the Sidewalk thread */
+static atomic_t stat_received;
+static atomic_t stat_dropped;
+static atomic_t stat_queue_hwm;
 
-// 	while (1) {
-// 		struct at_rx_msg rx_msg;
-// 		if (!k_msgq_get(&at_rx_task_msgq, &rx_msg, K_FOREVER)) {
-// 			//do something with the downlink messge
+/* Written by the receive task only */
+static uint32_t stat_handled;
+static uint32_t stat_unknown;
+static uint32_t stat_malformed;
+static uint32_t latency_count;
+static uint32_t latency_last;
+static uint32_t latency_max;
+static uint64_t latency_total;
 
+/**
+ * CONFIG: byte 1 selects the fields to change, bytes 2-5 carry motion period
+ * (min), motion scan period (s), static scan period (min) and motion
+ * threshold. Either every selected field is valid and they change together,
+ * or nothing changes.
+ */
+static int dl_config(at_ctx_t *at_ctx, const uint8_t *payload, size_t len)
+{
+	uint8_t mask = payload[1];
+	struct at_config conf;
+	uint32_t fields = 0;
 
-// 		}
-// 	}
+	ARG_UNUSED(len);
 
-// }
+	if (mask == 0 || (mask & ~GENMASK(3, 0))) {
+		return -EINVAL;
+	}
+
+	if (mask & DL_CONFIG_MOTION_PERIOD) {
+		conf.motion_period = payload[2];
+		fields |= AT_CONF_MOTION_PERIOD;
+	}
+	if (mask & DL_CONFIG_SCAN_MOTION) {
+		conf.scan_freq_motion = payload[3];
+		fields |= AT_CONF_SCAN_MOTION;
+	}
+	if (mask & DL_CONFIG_SCAN_STATIC) {
+		conf.scan_freq_static = payload[4];
+		fields |= AT_CONF_SCAN_STATIC;
+	}
+	if (mask & DL_CONFIG_MOTION_THRES) {
+		conf.motion_thres = payload[5];
+		fields |= AT_CONF_MOTION_THRES;
+	}
+
+	return at_config_stage(&at_ctx->at_conf, &conf, fields);
+}
+
+static int dl_scan_now(at_ctx_t *at_ctx, const uint8_t *payload, size_t len)
+{
+	ARG_UNUSED(at_ctx);
+	ARG_UNUSED(payload);
+	ARG_UNUSED(len);
+
+	at_event_send(EVENT_SCAN_SENSORS);
+	return 0;
+}
+
+static int dl_locate(at_ctx_t *at_ctx, const uint8_t *payload, size_t len)
+{
+	ARG_UNUSED(at_ctx);
+	ARG_UNUSED(payload);
+	ARG_UNUSED(len);
+
+	at_event_send(EVENT_SCAN_LOC);
+	return 0;
+}
+
+static const struct dl_command dl_commands[] = {
+	{ DL_OPCODE_CONFIG, DL_CONFIG_SIZE, DL_CONFIG_SIZE, "CONFIG", dl_config },
+	{ DL_OPCODE_SCAN_NOW, 1, 1, "SCAN_NOW", dl_scan_now },
+	{ DL_OPCODE_LOCATE, 1, 1, "LOCATE", dl_locate },
+};
+
+static const struct dl_command *dl_command_find(uint8_t opcode)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(dl_commands); i++) {
+		if (dl_commands[i].opcode == opcode) {
+			return &dl_commands[i];
+		}
+	}
+	return NULL;
+}
+
+static void dl_dispatch(at_ctx_t *at_ctx, const struct at_rx_msg *rx_msg)
+{
+	if (rx_msg->pld_size == 0) {
+		stat_malformed++;
+		LOG_WRN("Empty downlink id %u", rx_msg->msg_id);
+		return;
+	}
+
+	const struct dl_command *cmd = dl_command_find(rx_msg->rx_payload[0]);
+
+	if (cmd == NULL) {
+		stat_unknown++;
+		LOG_WRN("Unknown downlink opcode 0x%02x id %u", rx_msg->rx_payload[0],
+			rx_msg->msg_id);
+		return;
+	}
+
+	if (rx_msg->pld_size < cmd->min_len || rx_msg->pld_size > cmd->max_len) {
+		stat_malformed++;
+		LOG_WRN("Downlink %s id %u: bad length %u", cmd->name, rx_msg->msg_id,
+			(uint32_t)rx_msg->pld_size);
+		return;
+	}
+
+	int err = cmd->handler(at_ctx, rx_msg->rx_payload, rx_msg->pld_size);
+
+	if (err) {
+		LOG_ERR("Downlink %s id %u failed: %d", cmd->name, rx_msg->msg_id, err);
+		return;
+	}
+
+	stat_handled++;
+	LOG_INF("Downlink %s id %u handled", cmd->name, rx_msg->msg_id);
+}
+
+static void latency_record(uint32_t rx_cycles)
+{
+	uint32_t latency = k_cycle_get_32() - rx_cycles;
+
+	latency_count++;
+	latency_last = latency;
+	latency_total += latency;
+	if (latency > latency_max) {
+		latency_max = latency;
+	}
+}
+
+static void at_rx_task(void *ctx, void *unused, void *unused2)
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)ctx;
+	ARG_UNUSED(unused);
+	ARG_UNUSED(unused2);
+
+	LOG_DBG("Starting %s ...", __FUNCTION__);
+
+	while (1) {
+		struct at_rx_msg rx_msg;
+
+		if (!k_msgq_get(&at_rx_task_msgq, &rx_msg, K_FOREVER)) {
+			dl_dispatch(at_ctx, &rx_msg);
+			latency_record(rx_msg.rx_cycles);
+		}
+	}
+}
+
+void at_rx_task_msg_q_write(struct at_rx_msg *rx_msg)
+{
+	atomic_inc(&stat_received);
+
+	// Never block sid_process(), drop the downlink instead
+	int ret = k_msgq_put(&at_rx_task_msgq, rx_msg, K_NO_WAIT);
+
+	if (ret) {
+		atomic_inc(&stat_dropped);
+		LOG_ERR("Downlink id %u dropped, receive queue full", rx_msg->msg_id);
+		return;
+	}
+
+	atomic_val_t used = k_msgq_num_used_get(&at_rx_task_msgq);
+	atomic_val_t hwm = atomic_get(&stat_queue_hwm);
+
+	while (used > hwm && !atomic_cas(&stat_queue_hwm, hwm, used)) {
+		hwm = atomic_get(&stat_queue_hwm);
+	}
+}
+
+void at_downlink_init(at_ctx_t *at_ctx)
+{
+	(void)k_thread_create(&at_rx_thread, at_rx_thread_stack,
+			      K_THREAD_STACK_SIZEOF(at_rx_thread_stack), at_rx_task, at_ctx, NULL,
+			      NULL, RECEIVE_TASK_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&at_rx_thread, "at_rx_task");
+}
+
+void at_downlink_stats_get(struct at_downlink_stats *stats)
+{
+	*stats = (struct at_downlink_stats){
+		.received = atomic_get(&stat_received),
+		.dropped = atomic_get(&stat_dropped),
+		.handled = stat_handled,
+		.unknown = stat_unknown,
+		.malformed = stat_malformed,
+		.queue_hwm = atomic_get(&stat_queue_hwm),
+		.latency_count = latency_count,
+		.latency_last_us = k_cyc_to_us_floor32(latency_last),
+		.latency_mean_us = latency_count ?
+			k_cyc_to_us_floor32((uint32_t)(latency_total / latency_count)) : 0,
+		.latency_max_us = k_cyc_to_us_floor32(latency_max),
+	};
+}
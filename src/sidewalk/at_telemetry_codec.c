@@ -0,0 +1,258 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#include <errno.h>
+#include <string.h>
+
+#include <sidewalk/at_telemetry_codec.h>
+
+/**
+ * SENSOR_DELTA frame format:
+ * Byte 0: Message type (upper 2 bits) | Record count N (lower 6 bits)
+ * Bytes 1..: MSB-first bitstream, zero padded to a byte boundary
+ *
+ * Record 0 is absolute:
+ *   battery 7 | temperature 8 (signed) | humidity 7 | motion 1 | accel 7
+ * Records 1..N-1 code battery, temperature, humidity and accel as a delta
+ * against the previous record, followed by the raw motion bit:
+ *   0                  delta 0
+ *   10  + 3 bit signed delta -4..3
+ *   110 + 6 bit signed delta -32..31
+ *   111 + raw field    anything else
+ */
+#define HEADER_SIZE 1
+#define COUNT_MASK 0x3F
+
+#define BATT_BITS 7
+#define TEMP_BITS 8
+#define HUM_BITS 7
+#define ACCEL_BITS 7
+
+#define SMALL_BITS 3
+#define MEDIUM_BITS 6
+
+struct bit_writer {
+	uint8_t *buf;
+	size_t size;		// in bits
+	size_t pos;
+};
+
+struct bit_reader {
+	const uint8_t *buf;
+	size_t size;		// in bits
+	size_t pos;
+};
+
+static bool put_bits(struct bit_writer *w, uint32_t value, uint8_t bits)
+{
+	if (w->pos + bits > w->size) {
+		return false;
+	}
+	for (int i = bits - 1; i >= 0; i--, w->pos++) {
+		uint8_t mask = 0x80 >> (w->pos & 7);
+
+		if (value & (1U << i)) {
+			w->buf[w->pos >> 3] |= mask;
+		} else {
+			w->buf[w->pos >> 3] &= ~mask;
+		}
+	}
+	return true;
+}
+
+static bool get_bits(struct bit_reader *r, uint8_t bits, uint32_t *value)
+{
+	if (r->pos + bits > r->size) {
+		return false;
+	}
+	*value = 0;
+	for (uint8_t i = 0; i < bits; i++, r->pos++) {
+		*value = (*value << 1) | ((r->buf[r->pos >> 3] >> (7 - (r->pos & 7))) & 1);
+	}
+	return true;
+}
+
+static int32_t sign_extend(uint32_t value, uint8_t bits)
+{
+	uint32_t sign = 1U << (bits - 1);
+
+	return (int32_t)((value ^ sign) - sign);
+}
+
+static bool put_field(struct bit_writer *w, int32_t prev, int32_t value, uint8_t raw_bits)
+{
+	int32_t delta = value - prev;
+
+	if (delta == 0) {
+		return put_bits(w, 0x0, 1);
+	}
+	if (delta >= -(1 << (SMALL_BITS - 1)) && delta < (1 << (SMALL_BITS - 1))) {
+		return put_bits(w, 0x2, 2) &&
+		       put_bits(w, (uint32_t)delta & ((1U << SMALL_BITS) - 1), SMALL_BITS);
+	}
+	if (delta >= -(1 << (MEDIUM_BITS - 1)) && delta < (1 << (MEDIUM_BITS - 1))) {
+		return put_bits(w, 0x6, 3) &&
+		       put_bits(w, (uint32_t)delta & ((1U << MEDIUM_BITS) - 1), MEDIUM_BITS);
+	}
+	return put_bits(w, 0x7, 3) && put_bits(w, (uint32_t)value & ((1U << raw_bits) - 1), raw_bits);
+}
+
+static bool get_field(struct bit_reader *r, int32_t prev, uint8_t raw_bits, bool is_signed,
+		      int32_t *value)
+{
+	uint32_t bits;
+
+	if (!get_bits(r, 1, &bits)) {
+		return false;
+	}
+	if (bits == 0) {
+		*value = prev;
+		return true;
+	}
+	if (!get_bits(r, 1, &bits)) {
+		return false;
+	}
+	if (bits == 0) {
+		if (!get_bits(r, SMALL_BITS, &bits)) {
+			return false;
+		}
+		*value = prev + sign_extend(bits, SMALL_BITS);
+		return true;
+	}
+	if (!get_bits(r, 1, &bits)) {
+		return false;
+	}
+	if (bits == 0) {
+		if (!get_bits(r, MEDIUM_BITS, &bits)) {
+			return false;
+		}
+		*value = prev + sign_extend(bits, MEDIUM_BITS);
+		return true;
+	}
+	if (!get_bits(r, raw_bits, &bits)) {
+		return false;
+	}
+	*value = is_signed ? sign_extend(bits, raw_bits) : (int32_t)bits;
+	return true;
+}
+
+static bool put_sample(struct bit_writer *w, const struct telemetry_sample *prev,
+		       const struct telemetry_sample *s)
+{
+	if (prev == NULL) {
+		return put_bits(w, s->batt, BATT_BITS) &&
+		       put_bits(w, (uint8_t)s->temp, TEMP_BITS) &&
+		       put_bits(w, s->hum, HUM_BITS) &&
+		       put_bits(w, s->motion, 1) &&
+		       put_bits(w, s->accel, ACCEL_BITS);
+	}
+	return put_field(w, prev->batt, s->batt, BATT_BITS) &&
+	       put_field(w, prev->temp, s->temp, TEMP_BITS) &&
+	       put_field(w, prev->hum, s->hum, HUM_BITS) &&
+	       put_field(w, prev->accel, s->accel, ACCEL_BITS) &&
+	       put_bits(w, s->motion, 1);
+}
+
+int telemetry_delta_encode(const struct telemetry_sample *samples, size_t count,
+			   uint8_t *buf, size_t buf_size, size_t *encoded)
+{
+	struct bit_writer w = { .buf = buf + HEADER_SIZE, .pos = 0 };
+	size_t n;
+
+	*encoded = 0;
+	if (buf_size <= HEADER_SIZE) {
+		return -EINVAL;
+	}
+	w.size = (buf_size - HEADER_SIZE) * 8;
+	memset(w.buf, 0, buf_size - HEADER_SIZE);
+
+	for (n = 0; n < count && n < TELEMETRY_DELTA_MAX_RECORDS; n++) {
+		size_t mark = w.pos;
+
+		if (!put_sample(&w, n ? &samples[n - 1] : NULL, &samples[n])) {
+			// Roll back the partial record and clear its bits
+			for (size_t i = mark; i < w.pos; i++) {
+				w.buf[i >> 3] &= ~(0x80 >> (i & 7));
+			}
+			w.pos = mark;
+			break;
+		}
+	}
+	if (n == 0) {
+		return -EINVAL;
+	}
+
+	buf[0] = (TELEMETRY_MSG_TYPE_DELTA << 6) | (uint8_t)n;
+	*encoded = n;
+	return HEADER_SIZE + (w.pos + 7) / 8;
+}
+
+int telemetry_delta_decode(const uint8_t *buf, size_t len,
+			   struct telemetry_sample *out, size_t max_samples)
+{
+	struct bit_reader r;
+	size_t count;
+	uint32_t bits;
+	int32_t value;
+
+	if (len <= HEADER_SIZE || (buf[0] >> 6) != TELEMETRY_MSG_TYPE_DELTA) {
+		return -EINVAL;
+	}
+	count = buf[0] & COUNT_MASK;
+	if (count == 0) {
+		return -EINVAL;
+	}
+	if (count > max_samples) {
+		return -ENOMEM;
+	}
+
+	r = (struct bit_reader){ .buf = buf + HEADER_SIZE, .size = (len - HEADER_SIZE) * 8 };
+
+	if (!get_bits(&r, BATT_BITS, &bits)) {
+		return -EINVAL;
+	}
+	out[0].batt = bits;
+	if (!get_bits(&r, TEMP_BITS, &bits)) {
+		return -EINVAL;
+	}
+	out[0].temp = (int8_t)sign_extend(bits, TEMP_BITS);
+	if (!get_bits(&r, HUM_BITS, &bits)) {
+		return -EINVAL;
+	}
+	out[0].hum = bits;
+	if (!get_bits(&r, 1, &bits)) {
+		return -EINVAL;
+	}
+	out[0].motion = bits;
+	if (!get_bits(&r, ACCEL_BITS, &bits)) {
+		return -EINVAL;
+	}
+	out[0].accel = bits;
+
+	for (size_t n = 1; n < count; n++) {
+		const struct telemetry_sample *prev = &out[n - 1];
+
+		if (!get_field(&r, prev->batt, BATT_BITS, false, &value)) {
+			return -EINVAL;
+		}
+		out[n].batt = value;
+		if (!get_field(&r, prev->temp, TEMP_BITS, true, &value)) {
+			return -EINVAL;
+		}
+		out[n].temp = value;
+		if (!get_field(&r, prev->hum, HUM_BITS, false, &value)) {
+			return -EINVAL;
+		}
+		out[n].hum = value;
+		if (!get_field(&r, prev->accel, ACCEL_BITS, false, &value)) {
+			return -EINVAL;
+		}
+		out[n].accel = value;
+		if (!get_bits(&r, 1, &bits)) {
+			return -EINVAL;
+		}
+		out[n].motion = bits;
+	}
+
+	return count;
+}
@@ -3,12 +3,18 @@
 
 #include <sid_api.h>
 #include <sid_error.h>
+#include <string.h>
 #include <zephyr/kernel.h>
+#include <zephyr/random/random.h>
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(at_uplink, CONFIG_TRACKER_LOG_LEVEL);
 
 #include <asset_tracker.h>
 #include <sidewalk/at_uplink.h>
+#include <peripherals/at_timers.h>
+#include <sidewalk/at_telemetry_codec.h>
+#include <peripherals/at_sensors.h>
+#include <peripherals/at_storage.h>
 
 /**
  * Simplified sensor telemetry payload format (5 bytes):
@@ -18,79 +24,875 @@ LOG_MODULE_REGISTER(at_uplink, CONFIG_TRACKER_LOG_LEVEL);
  * Byte 3: Humidity (0-100%)
  * Byte 4: Motion flag (bit 7) | Peak acceleration (bits 0-6)
  */
-#define SENSOR_TELEMETRY_SIZE 5
+#define SENSOR_TELEMETRY_SIZE UPLINK_TELEMETRY_SIZE
+#define UPLINK_ACK_TTL_S 60
+#define UPLINK_BACKOFF_MAX_MS 60000
+#define MG_TO_MS2_NUM 981		// 9.81 m/s2 per g
+#define MG_TO_MS2_DEN 100000
 #define MSG_TYPE_SENSOR_TELEMETRY 0x01
 
-void at_send_uplink(at_ctx_t *context) 
+/**
+ * Batched sensor telemetry payload format (1 + 4 * N bytes):
+ * Byte 0: Message type (upper 2 bits) | Record count N (lower 6 bits)
+ * Bytes 1..: N records, oldest first, each laid out as bytes 1-4 of
+ *            SENSOR_TELEMETRY
+ *
+ * With CONFIG_TELEMETRY_DELTA_ENCODING batches are sent as SENSOR_DELTA
+ * frames instead, see at_telemetry_codec.c.
+ */
+#define MSG_TYPE_SENSOR_BATCH 0x02
+#define BATCH_HEADER_SIZE 1
+#define BATCH_RECORD_SIZE 4
+#define BATCH_RECORDS_MAX 0x3F		// record count field
+#define DELTA_RECORD_MAX_SIZE 6		// worst case SENSOR_DELTA record, rounded up
+
+/**
+ * Sensor aggregate payload format (11 bytes), one per uplink when background
+ * sampling is on (CONFIG_SENSOR_SAMPLE_S > 0):
+ * Byte 0: Message type (upper 2 bits) | Reserved (lower 6 bits)
+ * Byte 1: Samples in the window (saturates at 255)
+ * Byte 2: Window length in minutes (saturates at 255)
+ * Byte 3-5: Temperature min, max, mean (signed, degrees C)
+ * Byte 6-8: Humidity min, max, mean (0-100%)
+ * Byte 9-10: Acceleration magnitude max, mean (m/s2)
+ */
+#define MSG_TYPE_SENSOR_AGGREGATE 0x00
+#define SENSOR_AGGREGATE_SIZE 11
+
+/**
+ * Location bundle payload format (3 + N + 5 bytes), a scan-only location
+ * result and the cycle's sample in one frame (CONFIG_LOC_BUNDLE_TELEMETRY):
+ * Byte 0: Message type 0x00 (upper 2 bits) | Subtype 0x01 (lower 6 bits)
+ * Byte 1: Location effort mode of the scan
+ * Byte 2: Scan result length N
+ * Bytes 3..3+N-1: Scan result as returned by SID_LOCATION_SCAN_ONLY
+ * Bytes 3+N..: SENSOR_TELEMETRY frame
+ *
+ * Type 0x00 frames carry a subtype in the lower 6 bits, the aggregate frame
+ * is subtype 0.
+ */
+#define MSG_SUBTYPE_LOCATION_BUNDLE 0x01
+#define LOCATION_BUNDLE_HEADER_SIZE 3
+
+/*
+ * LoRa airtime model used for the batching report. Sidewalk does not expose
+ * its PHY settings, so these are estimates: SF8 / 500 kHz / CR 4/5, explicit
+ * header, CRC on, and a fixed Sidewalk network header + MIC per frame.
+ */
+#define LORA_SF 8
+#define LORA_BW_KHZ 500
+#define LORA_CR 1
+#define LORA_PREAMBLE_SYMB 8
+#define SID_FRAME_OVERHEAD 16
+
+static struct telemetry_sample batch[UPLINK_BATCH_MAX];
+static uint8_t batch_count;
+static size_t batch_mtu;		// frame size limit the batch was packed for
+static uint32_t batch_link;		// link mask the batch is sent on
+
+static uint8_t drained;		// leading batch samples read from the flash log
+
+/* Location scan result to send with the next sample, see at_uplink_bundle() */
+static const uint8_t *bundle_scan;
+static uint8_t bundle_size;
+static uint8_t bundle_mode;
+static bool batch_bundle;		// frame 0 of the batch is the bundle
+static int bundle_result = -ENOENT;	// see at_uplink_bundle_result()
+
+/*
+ * Packed frames back to back. Every frame holds at least one sample, except
+ * the aggregate frame that may close the batch.
+ */
+#define UPLINK_FRAMES_MAX (UPLINK_BATCH_MAX + 1)
+static uint8_t frame_pool[MAX(UPLINK_BATCH_MAX * (BATCH_HEADER_SIZE + DELTA_RECORD_MAX_SIZE) +
+			      SENSOR_AGGREGATE_SIZE, UPLINK_MTU_MAX)];
+static uint16_t frame_offset[UPLINK_FRAMES_MAX];
+static uint8_t frame_size[UPLINK_FRAMES_MAX];
+static uint8_t frame_first[UPLINK_FRAMES_MAX];	// first batch sample in each frame
+static uint8_t frames_resolved;
+static uint64_t failed_mask;		// one bit per frame, UPLINK_FRAMES_MAX of them
+static bool batch_on_air;		// the stack accepted a frame of this batch
+
+/*
+ * Frames handed to sid_put_msg() live in a slab buffer until the stack
+ * reports their message id through on_msg_sent or on_send_error, so several
+ * can be queued at once.
+ */
+struct uplink_buf {
+	uint16_t id;
+	uint8_t frame;
+	uint8_t size;
+	uint8_t attempts;
+	bool retry_pending;
+	uint32_t retry_at;		// k_uptime_get_32() of the next attempt
+	uint8_t data[UPLINK_MTU_MAX];
+} __aligned(4);
+
+K_MEM_SLAB_DEFINE_STATIC(uplink_slab, sizeof(struct uplink_buf), UPLINK_BUF_COUNT, 4);
+static struct uplink_buf *in_flight[UPLINK_BUF_COUNT];
+static uint8_t in_flight_count;
+static struct at_uplink_stats uplink_stats;
+
+static uint8_t mg_to_ms2(uint32_t mg)
 {
-	at_ctx_t *at_ctx = (at_ctx_t *)context;
+	return MIN(mg * MG_TO_MS2_NUM / MG_TO_MS2_DEN, 0x7F);
+}
 
-	static struct sid_msg msg;
-	sid_error_t sid_ret = SID_ERROR_NONE;
-	uint8_t payload[SENSOR_TELEMETRY_SIZE];
-	
+static int8_t mc_to_c(int32_t mc)
+{
+	return CLAMP(mc / 1000, INT8_MIN, INT8_MAX);
+}
+
+static uint8_t mpct_to_pct(int32_t mpct)
+{
+	return CLAMP(mpct / 1000, 0, 100);
+}
+
+/**
+ * Close the aggregation window into payload, returns the frame size or 0 if
+ * the window is empty
+ */
+static size_t encode_aggregate(uint8_t *payload)
+{
+	struct at_sensor_agg agg;
+
+	if (at_sensors_agg_take(&agg) == 0) {
+		return 0;
+	}
+
+	payload[0] = (MSG_TYPE_SENSOR_AGGREGATE << 6);
+	payload[1] = MIN(agg.count, UINT8_MAX);
+	payload[2] = MIN(agg.window_ms / MSEC_PER_SEC / 60, UINT8_MAX);
+	payload[3] = (uint8_t)mc_to_c(agg.temp_min_mc);
+	payload[4] = (uint8_t)mc_to_c(agg.temp_max_mc);
+	payload[5] = (uint8_t)mc_to_c(agg.temp_mean_mc);
+	payload[6] = mpct_to_pct(agg.hum_min_mpct);
+	payload[7] = mpct_to_pct(agg.hum_max_mpct);
+	payload[8] = mpct_to_pct(agg.hum_mean_mpct);
+	payload[9] = mg_to_ms2(agg.accel_max_mg);
+	payload[10] = mg_to_ms2(agg.accel_mean_mg);
+
+	LOG_INF("Aggregate of %u samples over %u s: temp %d..%d mC, hum %d..%d m%%", agg.count,
+		agg.window_ms / MSEC_PER_SEC, agg.temp_min_mc, agg.temp_max_mc, agg.hum_min_mpct,
+		agg.hum_max_mpct);
+	return SENSOR_AGGREGATE_SIZE;
+}
+
+static void sample_record(const at_ctx_t *at_ctx, struct telemetry_sample *sample)
+{
+	sample->batt = MIN(at_ctx->sensors.batt, 100);
+	sample->temp = mc_to_c(at_ctx->sensors.temp_mc);
+	sample->hum = mpct_to_pct(at_ctx->sensors.hum_mpct);
+	sample->motion = at_ctx->motion;
+	// Payload carries whole m/s2
+	sample->accel = mg_to_ms2(at_ctx->sensors.peak_accel_mg);
+}
+
+static void encode_record(const struct telemetry_sample *sample, uint8_t *record)
+{
+	record[0] = sample->batt;
+	record[1] = (uint8_t)sample->temp;
+	record[2] = sample->hum;
+	record[3] = (uint8_t)(sample->motion << 7) | sample->accel;
+}
+
+/**
+ * Pick the link a new batch is sent on and the largest frame it carries.
+ * A configured link that is up is used on its own, BLE first for its larger
+ * MTU. With none up the stack picks from the configured mask, so every link
+ * in it has to carry the frames.
+ */
+static uint32_t uplink_link(const at_ctx_t *at_ctx, size_t *mtu)
+{
+	static const enum sid_link_type links[] = {
+		SID_LINK_TYPE_1, SID_LINK_TYPE_2, SID_LINK_TYPE_3,
+	};
+	uint32_t up = at_ctx->at_conf.sid_link_type & at_ctx->link_status.link_status_mask;
+	uint32_t mask = at_ctx->at_conf.sid_link_type;
+	bool found = false;
+
+	for (int i = 0; i < ARRAY_SIZE(links); i++) {
+		if ((up & links[i]) != 0) {
+			mask = links[i];
+			break;
+		}
+	}
+
+	*mtu = UPLINK_MTU_MAX;
+	for (int i = 0; i < ARRAY_SIZE(links); i++) {
+		size_t link_mtu;
+
+		if ((mask & links[i]) == 0 ||
+		    sid_get_mtu(at_ctx->handle, links[i], &link_mtu) != SID_ERROR_NONE) {
+			continue;
+		}
+		*mtu = MIN(*mtu, link_mtu);
+		found = true;
+	}
+
+	// Fall back to the LoRa limit if the stack cannot tell
+	if (!found) {
+		*mtu = MAX_PAYLOAD_SIZE;
+	}
+	return mask;
+}
+
+uint8_t at_uplink_records_per_frame(size_t mtu)
+{
+	if (mtu <= BATCH_HEADER_SIZE) {
+		return 0;
+	}
+	return MIN((mtu - BATCH_HEADER_SIZE) / BATCH_RECORD_SIZE, BATCH_RECORDS_MAX);
+}
+
+/**
+ * Pack up to count samples into one SENSOR_BATCH frame of up to mtu bytes,
+ * returns its length, or -EINVAL if not even one sample fits
+ */
+static int pack_plain(const struct telemetry_sample *samples, size_t count, uint8_t *payload,
+		      size_t mtu, size_t *encoded)
+{
+	count = MIN(count, at_uplink_records_per_frame(mtu));
+	*encoded = count;
+	if (count == 0) {
+		return -EINVAL;
+	}
+	payload[0] = (MSG_TYPE_SENSOR_BATCH << 6) | count;
+	for (size_t i = 0; i < count; i++) {
+		encode_record(&samples[i], &payload[BATCH_HEADER_SIZE + i * BATCH_RECORD_SIZE]);
+	}
+	return BATCH_HEADER_SIZE + count * BATCH_RECORD_SIZE;
+}
+
+/**
+ * Pack the buffered samples into frames of up to mtu bytes, followed by the
+ * aggregate frame if requested, returns the number of frames
+ */
+static uint8_t pack_batch(size_t mtu, bool aggregate)
+{
+	uint16_t offset = 0;
+	uint8_t n = 0;
+#if defined(CONFIG_TELEMETRY_DELTA_ENCODING)
+	bool delta = true;
+#endif
+
+	mtu = MIN(mtu, UPLINK_MTU_MAX);
+	batch_mtu = mtu;
+	batch_bundle = false;
+
+	if (batch_count == 1 && bundle_size > 0 &&
+	    LOCATION_BUNDLE_HEADER_SIZE + bundle_size + SENSOR_TELEMETRY_SIZE <= mtu) {
+		frame_pool[0] = (MSG_TYPE_SENSOR_AGGREGATE << 6) | MSG_SUBTYPE_LOCATION_BUNDLE;
+		frame_pool[1] = bundle_mode;
+		frame_pool[2] = bundle_size;
+		memcpy(&frame_pool[LOCATION_BUNDLE_HEADER_SIZE], bundle_scan, bundle_size);
+		offset = LOCATION_BUNDLE_HEADER_SIZE + bundle_size;
+		frame_pool[offset] = (MSG_TYPE_SENSOR_TELEMETRY << 6);
+		encode_record(&batch[0], &frame_pool[offset + 1]);
+		offset += SENSOR_TELEMETRY_SIZE;
+		frame_offset[0] = 0;
+		frame_size[0] = offset;
+		frame_first[0] = 0;
+		n = 1;
+		batch_bundle = true;
+	} else if (batch_count == 1) {
+		if (bundle_size > 0) {
+			LOG_WRN("Location bundle does not fit MTU %zu, scan result dropped", mtu);
+		}
+		// Build sensor telemetry payload
+		frame_pool[0] = (MSG_TYPE_SENSOR_TELEMETRY << 6);  // Message type in upper 2 bits
+		encode_record(&batch[0], &frame_pool[1]);
+		frame_offset[0] = 0;
+		frame_size[0] = SENSOR_TELEMETRY_SIZE;
+		frame_first[0] = 0;
+		offset = SENSOR_TELEMETRY_SIZE;
+		n = 1;
+	}
+	if (bundle_size > 0 && !batch_bundle) {
+		bundle_result = -EMSGSIZE;
+	}
+	bundle_size = 0;
+
+	for (uint8_t first = n; first < batch_count; n++) {
+		uint8_t *payload = &frame_pool[offset];
+		size_t encoded;
+		int len = -EINVAL;
+
+		frame_first[n] = first;
+		frame_offset[n] = offset;
+
+#if defined(CONFIG_TELEMETRY_DELTA_ENCODING)
+		if (delta) {
+			len = telemetry_delta_encode(&batch[first], batch_count - first, payload,
+						     MIN(mtu, sizeof(frame_pool) - offset), &encoded);
+		}
+		if (delta && len < 0) {
+			// The SENSOR_BATCH records of the tail fit the pool as well
+			LOG_WRN("Delta encoding failed (%d), %u samples go as SENSOR_BATCH",
+				len, batch_count - first);
+			uplink_stats.encode_fallbacks++;
+			delta = false;
+		}
+#endif
+		if (len < 0) {
+			len = pack_plain(&batch[first], batch_count - first, payload, mtu, &encoded);
+		}
+		if (len < 0) {
+			break;
+		}
+		frame_size[n] = len;
+		first += encoded;
+		offset += frame_size[n];
+	}
+
+	// The window keeps running until a link can carry the aggregate frame
+	if (aggregate && mtu >= SENSOR_AGGREGATE_SIZE) {
+		frame_size[n] = encode_aggregate(&frame_pool[offset]);
+		if (frame_size[n] > 0) {
+			frame_offset[n] = offset;
+			frame_first[n] = batch_count;
+			n++;
+		}
+	}
+	return n;
+}
+
+/**
+ * Hand the samples that did not make it out to the flash log. Samples before
+ * first_unsent were delivered, including any log records among them. Later
+ * samples are all stored again, even ones whose frame did get through.
+ */
+static uint8_t batch_store_unsent(at_ctx_t *at_ctx, uint8_t first_unsent)
+{
+	uint8_t stored = 0;
+
+	if (drained > 0) {
+		at_storage_consume(MIN(drained, first_unsent));
+	}
+	for (uint8_t i = MAX(drained, first_unsent); i < batch_count; i++) {
+		if (at_storage_append(&batch[i]) == 0) {
+			stored++;
+		}
+	}
+	if (stored > 0) {
+		LOG_INF("Stored %u telemetry samples for later uplink", stored);
+	}
+
+	at_ctx->total_msg = 0;
+	at_ctx->cur_msg = 0;
+	batch_count = 0;
+	drained = 0;
+	if (bundle_size > 0) {
+		bundle_result = -EIO;
+		bundle_size = 0;
+	}
+	return stored;
+}
+
+/**
+ * Samples went to flash while the link stayed up, so no READY edge posts a
+ * drain for them. Drain after a pause, not at once, a link that just failed
+ * a batch would likely fail the drain too.
+ */
+static void batch_drain_later(const at_ctx_t *at_ctx)
+{
+	if (at_ctx->sidewalk_state == STATE_SIDEWALK_READY) {
+		storage_drain_timer_set_and_run(K_SECONDS(CONFIG_STORAGE_DRAIN_RETRY_S));
+	}
+}
+
+/**
+ * Put log records in front of the batch, oldest first, up to what one round
+ * of uplink buffers carries at this MTU
+ */
+static void batch_drain(size_t mtu)
+{
+	uint8_t burst = MIN(at_uplink_records_per_frame(mtu) * UPLINK_BUF_COUNT, UPLINK_BATCH_MAX);
+	uint8_t room;
+	int count;
+
+	if (burst <= batch_count || at_storage_backlog() == 0) {
+		return;
+	}
+	room = burst - batch_count;
+
+	memmove(&batch[room], batch, batch_count * sizeof(batch[0]));
+	count = at_storage_peek(batch, room);
+	if (count < 0) {
+		count = 0;
+	}
+	if (count < room) {
+		memmove(&batch[count], &batch[room], batch_count * sizeof(batch[0]));
+	}
+	drained = count;
+	batch_count += count;
+}
+
+bool at_uplink_bundle(at_ctx_t *at_ctx, const uint8_t *scan, size_t size, uint8_t mode)
+{
+	size_t mtu;
+
+	// Anything beyond the cycle's own sample keeps the normal uplink: the
+	// aggregate frame that closes every uplink with background sampling on,
+	// stored samples and batches
+	if (CONFIG_SENSOR_SAMPLE_S > 0 || at_ctx->at_conf.batch_size != 1 || batch_count > 0 ||
+	    at_ctx->uplink_drain || at_storage_backlog() > 0 ||
+	    at_ctx->sidewalk_state != STATE_SIDEWALK_READY) {
+		return false;
+	}
+	uplink_link(at_ctx, &mtu);
+	if (LOCATION_BUNDLE_HEADER_SIZE + size + SENSOR_TELEMETRY_SIZE > mtu) {
+		LOG_INF("Location scan of %zu bytes does not fit a bundle at MTU %zu", size, mtu);
+		return false;
+	}
+	bundle_scan = scan;
+	bundle_size = size;
+	bundle_mode = mode;
+	bundle_result = -EINPROGRESS;
+	return true;
+}
+
+bool at_uplink_sample(at_ctx_t *at_ctx)
+{
+	if (batch_count == TELEMETRY_BATCH_MAX) {
+		// Batch size was lowered while samples were buffered, send these first
+		return true;
+	}
+	sample_record(at_ctx, &batch[batch_count++]);
+	if (batch_count < at_ctx->at_conf.batch_size) {
+		LOG_INF("Buffered telemetry sample %u/%u", batch_count,
+			at_ctx->at_conf.batch_size);
+		return false;
+	}
+	return true;
+}
+
+static int uplink_buf_find(uint16_t id)
+{
+	for (int i = 0; i < ARRAY_SIZE(in_flight); i++) {
+		if (in_flight[i] != NULL && !in_flight[i]->retry_pending && in_flight[i]->id == id) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void uplink_buf_release(int slot)
+{
+	k_mem_slab_free(&uplink_slab, in_flight[slot]);
+	in_flight[slot] = NULL;
+	in_flight_count--;
+}
+
+/**
+ * Add a frame buffer to the in flight set, returns its slot
+ */
+static int uplink_buf_track(struct uplink_buf *buf)
+{
+	int slot = -1;
+
+	for (int i = 0; i < ARRAY_SIZE(in_flight); i++) {
+		if (in_flight[i] == NULL) {
+			in_flight[i] = buf;
+			slot = i;
+			break;
+		}
+	}
+	in_flight_count++;
+	uplink_stats.queued++;
+	uplink_stats.in_flight_hwm = MAX(uplink_stats.in_flight_hwm, in_flight_count);
+	return slot;
+}
+
+static void uplink_buf_release_all(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(in_flight); i++) {
+		if (in_flight[i] != NULL) {
+			k_mem_slab_free(&uplink_slab, in_flight[i]);
+			in_flight[i] = NULL;
+		}
+	}
+	in_flight_count = 0;
+	uplink_retry_timer_stop();
+}
+
+/**
+ * Hand a frame buffer to the stack, acked if configured
+ */
+static sid_error_t uplink_buf_put(at_ctx_t *at_ctx, struct uplink_buf *buf)
+{
+	struct sid_msg msg = { .data = buf->data, .size = buf->size };
 	struct sid_msg_desc desc = {
 		.type = SID_MSG_TYPE_NOTIFY,
-		.link_type = at_ctx->at_conf.sid_link_type,
+		.link_type = batch_link,
 		.link_mode = SID_LINK_MODE_CLOUD,
 	};
-	
-	// Build sensor telemetry payload
-	at_ctx->total_msg = 1;
-	at_ctx->cur_msg = 1;
-	
-	payload[0] = (MSG_TYPE_SENSOR_TELEMETRY << 6);  // Message type in upper 2 bits
-	payload[1] = at_ctx->sensors.batt;
-	payload[2] = (int8_t)at_ctx->sensors.temp;
-	payload[3] = (uint8_t)at_ctx->sensors.hum;
-	payload[4] = (uint8_t)(at_ctx->motion << 7);
-	payload[4] |= (uint8_t)((int)at_ctx->sensors.peak_accel) & 0x7F;
+	sid_error_t sid_ret;
 
-	LOG_HEXDUMP_DBG(payload, SENSOR_TELEMETRY_SIZE, "sensor_telemetry_payload");
+	if (at_ctx->at_conf.uplink_ack) {
+		// Retries are ours, with backoff, so the stack makes a single attempt
+		desc.msg_desc_attr.tx_attr.request_ack = true;
+		desc.msg_desc_attr.tx_attr.num_retries = 0;
+		desc.msg_desc_attr.tx_attr.ttl_in_seconds = UPLINK_ACK_TTL_S;
+	}
 
-	msg = (struct sid_msg){ .data = payload, .size = SENSOR_TELEMETRY_SIZE };
+	buf->attempts++;
+	buf->retry_pending = false;
 	sid_ret = sid_put_msg(at_ctx->handle, &msg, &desc);
+	if (sid_ret == SID_ERROR_NONE) {
+		buf->id = desc.id;
+		if (!batch_on_air) {
+			// The rest of the batch and its retries share this session
+			batch_on_air = true;
+			at_ctx->cycle.radio_sessions++;
+		}
+	}
+	return sid_ret;
+}
+
+/**
+ * Exponential backoff with up to 50% jitter: base, 2 x base, 4 x base, ...
+ */
+static uint32_t retry_backoff_ms(uint8_t attempts)
+{
+	// The cap on the shift keeps it clear of overflow, the max is hit well before
+	uint32_t backoff = MIN((uint32_t)CONFIG_UPLINK_BACKOFF_MS << MIN(attempts - 1, 15),
+			       UPLINK_BACKOFF_MAX_MS);
+
+	return backoff + sys_rand32_get() % (backoff / 2 + 1);
+}
+
+/**
+ * Arm the retry timer for the earliest pending retry
+ */
+static void retry_timer_rearm(void)
+{
+	uint32_t now = k_uptime_get_32();
+	int32_t next = INT32_MAX;
+
+	for (int i = 0; i < ARRAY_SIZE(in_flight); i++) {
+		if (in_flight[i] != NULL && in_flight[i]->retry_pending) {
+			next = MIN(next, (int32_t)(in_flight[i]->retry_at - now));
+		}
+	}
+	if (next != INT32_MAX) {
+		uplink_retry_timer_set_and_run(K_MSEC(MAX(next, 0)));
+	}
+}
+
+/**
+ * A frame attempt failed, returns true if it will be tried again
+ */
+static bool uplink_buf_retry(at_ctx_t *at_ctx, struct uplink_buf *buf)
+{
+	uint32_t delay;
+
+	if (!at_ctx->at_conf.uplink_ack || buf->attempts > at_ctx->at_conf.uplink_retries) {
+		return false;
+	}
 
-	if (SID_ERROR_NONE != sid_ret) {
-		LOG_ERR("Failed sending sensor telemetry, err:%d", (int)sid_ret);
+	delay = retry_backoff_ms(buf->attempts);
+	buf->retry_pending = true;
+	buf->retry_at = k_uptime_get_32() + delay;
+	uplink_stats.retries++;
+	LOG_WRN("Telemetry frame %u attempt %u failed, retrying in %u ms", buf->frame,
+		buf->attempts, delay);
+	retry_timer_rearm();
+	return true;
+}
+
+/**
+ * Every frame of the batch has been reported, settle the samples
+ */
+static void batch_finish(at_ctx_t *at_ctx)
+{
+	if (batch_bundle) {
+		bundle_result = (failed_mask & BIT64(0)) ? -EIO : 0;
+		batch_bundle = false;
+	}
+	if (failed_mask == 0) {
+		if (drained > 0) {
+			at_storage_consume(drained);
+		}
 		at_ctx->total_msg = 0;
 		at_ctx->cur_msg = 0;
-		return;
+		batch_count = 0;
+		drained = 0;
+		// Keep draining in bursts while the link holds
+		if (at_storage_backlog() > 0) {
+			at_event_send(EVENT_STORAGE_DRAIN);
+		}
+	} else {
+		// Log records are consumed oldest first, so only the ones ahead of
+		// the first failed frame can be released
+		if (batch_store_unsent(at_ctx, frame_first[u64_count_trailing_zeros(failed_mask)]) > 0) {
+			batch_drain_later(at_ctx);
+		}
+	}
+	at_event_send(EVENT_UPLINK_COMPLETE);
+}
+
+/**
+ * Give up on frame and every frame after it that is not queued yet
+ */
+static void frames_fail_from(at_ctx_t *at_ctx, uint8_t frame)
+{
+	uint8_t unsent = at_ctx->total_msg - frame;
+
+	failed_mask |= GENMASK64(at_ctx->total_msg - 1, frame);
+	frames_resolved += unsent;
+	uplink_stats.failed += unsent;
+	at_ctx->cur_msg = at_ctx->total_msg;
+
+	if (frames_resolved == at_ctx->total_msg) {
+		batch_finish(at_ctx);
+	}
+}
+
+/**
+ * Frame done, either delivered or failed
+ */
+static void frame_resolved(at_ctx_t *at_ctx, int frame, bool failed)
+{
+	if (failed) {
+		failed_mask |= BIT64(frame);
+		uplink_stats.failed++;
+	} else {
+		uplink_stats.sent++;
+	}
+	frames_resolved++;
+
+	if (frames_resolved == at_ctx->total_msg) {
+		batch_finish(at_ctx);
+	} else if (at_ctx->cur_msg < at_ctx->total_msg) {
+		// A buffer was freed, queue the rest of the batch
+		at_event_send(EVENT_SEND_UPLINK);
 	}
-	
-	LOG_INF("Queued sensor telemetry uplink, id:%u (batt=%d%%, temp=%dC, hum=%d%%, motion=%d)", 
-		desc.id, 
-		at_ctx->sensors.batt,
-		(int8_t)at_ctx->sensors.temp,
-		(uint8_t)at_ctx->sensors.hum,
-		at_ctx->motion);
 }
 
-void at_msg_sent(at_ctx_t *context) 
+void at_send_uplink(at_ctx_t *context) 
 {
 	at_ctx_t *at_ctx = (at_ctx_t *)context;
 
-	if (at_ctx->total_msg > 0) {
-		if (at_ctx->cur_msg < at_ctx->total_msg) {
-			// Send next message (if any)
-			at_event_send(EVENT_SEND_UPLINK);
-		} else {
-			// Uplink complete
+	sid_error_t sid_ret = SID_ERROR_NONE;
+	struct uplink_buf *buf;
+	int slot;
+	
+	if (at_ctx->total_msg == 0) {
+		if (at_ctx->sidewalk_state != STATE_SIDEWALK_READY) {
+			LOG_WRN("Sidewalk not ready, holding telemetry in flash");
+			batch_store_unsent(at_ctx, 0);
 			at_event_send(EVENT_UPLINK_COMPLETE);
-			at_ctx->total_msg = 0;	
-			at_ctx->cur_msg = 0;
+			return;
+		}
+		size_t mtu;
+
+		batch_link = uplink_link(at_ctx, &mtu);
+		if (mtu < SENSOR_TELEMETRY_SIZE) {
+			// No drain is scheduled, it would hit the same MTU. The next
+			// uplink or READY edge tries again.
+			LOG_ERR("MTU %zu too small for telemetry, holding it in flash", mtu);
+			batch_store_unsent(at_ctx, 0);
+			at_event_send(EVENT_UPLINK_COMPLETE);
+			return;
+		}
+		// A bundle carries the cycle's own sample only
+		if (bundle_size == 0) {
+			batch_drain(mtu);
+		}
+		if (batch_count == 0) {
+			at_event_send(EVENT_UPLINK_COMPLETE);
+			return;
+		}
+		// Drain-only uplinks leave the aggregation window running
+		at_ctx->total_msg = pack_batch(mtu, CONFIG_SENSOR_SAMPLE_S > 0 && !at_ctx->uplink_drain);
+		at_ctx->cur_msg = 0;
+		frames_resolved = 0;
+		failed_mask = 0;
+		batch_on_air = false;
+		LOG_INF("Packed %u telemetry samples (%u from flash) into %u frames, "
+			"link 0x%x MTU %u", batch_count, drained, at_ctx->total_msg, batch_link,
+			batch_mtu);
+	}
+
+	// Frames whose backoff has run out go first
+	for (int i = 0; i < ARRAY_SIZE(in_flight); i++) {
+		buf = in_flight[i];
+		if (buf == NULL || !buf->retry_pending ||
+		    (int32_t)(buf->retry_at - k_uptime_get_32()) > 0) {
+			continue;
+		}
+		sid_ret = uplink_buf_put(at_ctx, buf);
+		if (sid_ret != SID_ERROR_NONE && !uplink_buf_retry(at_ctx, buf)) {
+			uint8_t frame = buf->frame;
+
+			uplink_buf_release(i);
+			frame_resolved(at_ctx, frame, true);
+			if (at_ctx->total_msg == 0) {
+				return;
+			}
+		}
+	}
+	retry_timer_rearm();
+
+	// Queue as many frames as there are free buffers, the rest follow as
+	// earlier ones are reported sent
+	while (at_ctx->cur_msg < at_ctx->total_msg) {
+		uint8_t frame = at_ctx->cur_msg;
+
+		if (k_mem_slab_alloc(&uplink_slab, (void **)&buf, K_NO_WAIT) != 0) {
+			uplink_stats.buf_waits++;
+			break;
+		}
+
+		buf->frame = frame;
+		buf->size = frame_size[frame];
+		buf->attempts = 0;
+		memcpy(buf->data, &frame_pool[frame_offset[frame]], buf->size);
+		at_ctx->cur_msg++;
+
+		LOG_HEXDUMP_DBG(buf->data, buf->size, "sensor_telemetry_payload");
+
+		slot = uplink_buf_track(buf);
+		sid_ret = uplink_buf_put(at_ctx, buf);
+
+		if (SID_ERROR_NONE != sid_ret) {
+			LOG_ERR("Failed sending sensor telemetry, err:%d", (int)sid_ret);
+			if (uplink_buf_retry(at_ctx, buf)) {
+				// The stack refused it, the rest waits for the retry
+				break;
+			}
+			uplink_buf_release(slot);
+			// Nothing after this frame goes out either
+			frames_fail_from(at_ctx, frame);
+			return;
 		}
+
+		LOG_INF("Queued sensor telemetry uplink %u/%u, id:%u, %u in flight",
+			at_ctx->cur_msg, at_ctx->total_msg, buf->id, in_flight_count);
+	}
+}
+
+void at_msg_sent(at_ctx_t *context, const struct sid_msg_desc *msg_desc) 
+{
+	at_ctx_t *at_ctx = (at_ctx_t *)context;
+	int slot = uplink_buf_find(msg_desc->id);
+	uint8_t frame;
+
+	if (slot < 0) {
+		// Not one of ours, location sends share this callback
+		return;
 	}
+	frame = in_flight[slot]->frame;
+	if (in_flight[slot]->attempts == 1) {
+		uplink_stats.first_try++;
+	}
+	uplink_buf_release(slot);
+	frame_resolved(at_ctx, frame, false);
 }
 
-void at_send_error(at_ctx_t *context) 
+void at_send_error(at_ctx_t *context, const struct sid_msg_desc *msg_desc) 
 {
 	at_ctx_t *at_ctx = (at_ctx_t *)context;
+	int slot = uplink_buf_find(msg_desc->id);
+	uint8_t frame;
 
+	if (slot < 0) {
+		return;
+	}
+	if (uplink_buf_retry(at_ctx, in_flight[slot])) {
+		return;
+	}
+	frame = in_flight[slot]->frame;
+	LOG_ERR("Error sending telemetry frame %u, giving up", frame);
+	uplink_buf_release(slot);
+	frame_resolved(at_ctx, frame, true);
+}
+
+void at_uplink_abort(at_ctx_t *at_ctx)
+{
 	if (at_ctx->total_msg > 0) {
-		LOG_ERR("Error sending message, aborting uplink");
-		at_event_send(EVENT_UPLINK_COMPLETE);
-		at_ctx->total_msg = 0;	
-		at_ctx->cur_msg = 0;
+		// Frames in flight may still be delivered, at worst they are sent twice
+		for (int i = 0; i < ARRAY_SIZE(in_flight); i++) {
+			if (in_flight[i] != NULL) {
+				failed_mask |= BIT64(in_flight[i]->frame);
+			}
+		}
+		if (at_ctx->cur_msg < at_ctx->total_msg) {
+			failed_mask |= GENMASK64(at_ctx->total_msg - 1, at_ctx->cur_msg);
+		}
+		uplink_buf_release_all();
+		if (batch_store_unsent(at_ctx, frame_first[u64_count_trailing_zeros(failed_mask)]) > 0) {
+			batch_drain_later(at_ctx);
+		}
+	} else if (batch_count >= at_ctx->at_conf.batch_size) {
+		if (batch_store_unsent(at_ctx, 0) > 0) {
+			batch_drain_later(at_ctx);
+		}
+	}
+	// A scan waiting for the uplink is not kept, one in flight may still
+	// arrive but counts as lost
+	if (bundle_size > 0 || batch_bundle) {
+		bundle_result = -EIO;
+	}
+	bundle_size = 0;
+	batch_bundle = false;
+}
+
+int at_uplink_bundle_result(void)
+{
+	int result = bundle_result;
+
+	if (result != -EINPROGRESS) {
+		bundle_result = -ENOENT;
+	}
+	return result;
+}
+
+void at_uplink_stats_get(struct at_uplink_stats *stats)
+{
+	*stats = uplink_stats;
+	stats->in_flight = in_flight_count;
+	stats->mtu = batch_mtu;
+}
+
+uint8_t at_uplink_batch_frames(uint8_t records)
+{
+	return DIV_ROUND_UP(records, at_uplink_records_per_frame(MAX_PAYLOAD_SIZE));
+}
+
+size_t at_uplink_batch_bytes(uint8_t records)
+{
+	if (records <= 1) {
+		return SENSOR_TELEMETRY_SIZE;
+	}
+	return at_uplink_batch_frames(records) * BATCH_HEADER_SIZE + records * BATCH_RECORD_SIZE;
+}
+
+uint32_t at_uplink_airtime_us(size_t payload_size)
+{
+	/* Semtech LoRa time on air, explicit header, CRC on, no low data rate optimize */
+	uint32_t symb_us = (1U << LORA_SF) * 1000U / LORA_BW_KHZ;
+	int32_t phy_len = payload_size + SID_FRAME_OVERHEAD;
+	int32_t num = 8 * phy_len - 4 * LORA_SF + 28 + 16;
+	uint32_t payload_symb = 8 + MAX(DIV_ROUND_UP(num, 4 * LORA_SF) * (LORA_CR + 4), 0);
+
+	return ((LORA_PREAMBLE_SYMB * 4 + 17) * symb_us) / 4 + payload_symb * symb_us;
+}
+
+uint32_t at_uplink_batch_airtime_us(uint8_t records)
+{
+	uint8_t frames = at_uplink_batch_frames(records);
+	uint32_t airtime = 0;
+
+	if (records <= 1) {
+		return at_uplink_airtime_us(SENSOR_TELEMETRY_SIZE);
+	}
+	for (uint8_t i = 0; i < frames; i++) {
+		uint8_t per_frame = at_uplink_records_per_frame(MAX_PAYLOAD_SIZE);
+		uint8_t count = MIN(records - i * per_frame, per_frame);
+
+		airtime += at_uplink_airtime_us(BATCH_HEADER_SIZE + count * BATCH_RECORD_SIZE);
 	}
+	return airtime;
 }
@@ -1,6 +1,8 @@
 // Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
 // SPDX-License-Identifier: MIT-0
 
+#include <string.h>
+
 #include <sid_api.h>
 #include <sid_error.h>
 #include <sid_hal_reset_ifc.h>
@@ -10,6 +12,8 @@
 #endif
 
 #include <asset_tracker.h>
+#include "peripherals/at_battery.h"
+#include "peripherals/at_storage.h"
 #include "peripherals/at_timers.h"
 #include <sidewalk/at_uplink.h>
 
@@ -37,13 +41,15 @@ static void on_sidewalk_msg_received(const struct sid_msg_desc *msg_desc, const
 	LOG_INF("received message(type: %d, link_mode: %d, id: %u size %u)", (int)msg_desc->type,
 		(int)msg_desc->link_mode, msg_desc->id, msg->size);
 	LOG_HEXDUMP_DBG((uint8_t *)msg->data, msg->size, "Message data: ");
-	
-	// struct at_rx_msg rx_msg = {
-	// 	.msg_id = msg_desc->id,
-	// 	.pld_size = msg->size,
-	// };
-	// memcpy(rx_msg.rx_payload, msg->data, MIN(msg->size, MAX_PAYLOAD_SIZE));
-	// at_rx_task_msg_q_write(&rx_msg);
+
+	// Decoded on the receive task, keep sid_process() short
+	struct at_rx_msg rx_msg = {
+		.msg_id = msg_desc->id,
+		.pld_size = msg->size,
+		.rx_cycles = k_cycle_get_32(),
+	};
+	memcpy(rx_msg.rx_payload, msg->data, MIN(msg->size, MAX_PAYLOAD_SIZE));
+	at_rx_task_msg_q_write(&rx_msg);
 }
 
 static void on_sidewalk_msg_sent(const struct sid_msg_desc *msg_desc, void *context)
@@ -52,7 +58,8 @@ static void on_sidewalk_msg_sent(const struct sid_msg_desc *msg_desc, void *cont
 	CLI_register_message_send();
 #endif
 	LOG_INF("sent message to Sidewalk(type: %d, id: %u)", (int)msg_desc->type, msg_desc->id);
-	at_msg_sent(context);
+	at_battery_tx_done();
+	at_msg_sent(context, msg_desc);
 }
 
 static void on_sidewalk_send_error(sid_error_t error, const struct sid_msg_desc *msg_desc,
@@ -63,7 +70,7 @@ static void on_sidewalk_send_error(sid_error_t error, const struct sid_msg_desc
 #endif
 	LOG_ERR("failed to send message(type: %d, id: %u), err:%d", (int)msg_desc->type,
 		msg_desc->id, (int)error);
-	at_send_error(context);
+	at_send_error(context, msg_desc);
 }
 
 static void on_sidewalk_status_changed(const struct sid_status *status, void *context)
@@ -77,6 +84,10 @@ static void on_sidewalk_status_changed(const struct sid_status *status, void *co
 #endif
 	switch (status->state) {
 	case SID_STATE_READY:
+		if (at_ctx->sidewalk_state != STATE_SIDEWALK_READY && at_storage_backlog() > 0) {
+			// Link is back, flush what was stored while it was down
+			at_event_send(EVENT_STORAGE_DRAIN);
+		}
 		at_ctx->sidewalk_state = STATE_SIDEWALK_READY;
 		break;
 	case SID_STATE_NOT_READY:
@@ -104,16 +115,14 @@ static void on_sidewalk_status_changed(const struct sid_status *status, void *co
 	at_ctx->link_status.time_sync_status = status->detail.time_sync_status;
 
 	if (at_ctx->sidewalk_state == STATE_SIDEWALK_READY) {
-		if(at_ctx->state == AT_STATE_INIT) {
-			at_ctx->state = AT_STATE_RUN;
-			LOG_INF("Device time synchronized to Sidewalk network time. Asset tracker running...");
-			// Start the scan timer - first scan in 5 seconds
-			scan_timer_set_and_run(K_MSEC(5000));
-			// Don't stop the stack here - let the timer-triggered uplink complete first
+		/* Wake a pending BLE uplink once the BLE link comes up */
+		if (at_ctx->ble_conn_waiting &&
+		    (status->detail.link_status_mask & SID_LINK_TYPE_1) != 0) {
+			at_event_send(EVENT_BLE_CONNECTION_WAIT);
 		}
-		
+
 		/* If BLE location is pending and BLE link is up, trigger it now */
-		if (at_ctx->ble_location_pending && 
+		if (at_ctx->sm_state == AT_SM_BLE_L1 && 
 		    (status->detail.link_status_mask & SID_LINK_TYPE_1) != 0) {
 			LOG_INF("BLE ready, triggering L1 location...");
 			at_event_send(EVENT_BLE_LOCATION_READY);
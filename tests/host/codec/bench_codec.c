@@ -0,0 +1,105 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+/*
+ * SENSOR_DELTA encode/decode cost and size against the plain frames.
+ * Usage: bench_codec [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sidewalk/at_telemetry_codec.h>
+
+#define SAMPLES 32
+#define TELEMETRY_SIZE 5	// SENSOR_TELEMETRY, one sample
+#define BATCH_HEADER_SIZE 1	// SENSOR_BATCH header
+#define BATCH_RECORD_SIZE 4
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Slowly drifting environment, what a parked tracker reports */
+static void make_samples(struct telemetry_sample *s, size_t count)
+{
+	srand(7);
+	s[0] = (struct telemetry_sample){ .batt = 93, .temp = 22, .hum = 48, .accel = 0 };
+	for (size_t i = 1; i < count; i++) {
+		s[i] = s[i - 1];
+		s[i].temp += rand() % 3 - 1;
+		s[i].hum += rand() % 3 - 1;
+		s[i].batt -= (rand() % 16 == 0);
+		s[i].motion = (rand() % 8 == 0);
+		s[i].accel = s[i].motion ? rand() % 20 : 0;
+	}
+}
+
+static void bench_mtu(const struct telemetry_sample *s, size_t mtu, long iterations)
+{
+	struct telemetry_sample out[TELEMETRY_DELTA_MAX_RECORDS];
+	uint8_t frames[SAMPLES][255];
+	int lens[SAMPLES];
+	size_t bytes = 0;
+	int n_frames = 0;
+	double start, encode_ns, decode_ns;
+	volatile int sink = 0;
+
+	start = now_ns();
+	for (long it = 0; it < iterations; it++) {
+		n_frames = 0;
+		bytes = 0;
+		for (size_t first = 0; first < SAMPLES; n_frames++) {
+			size_t encoded;
+
+			lens[n_frames] = telemetry_delta_encode(&s[first], SAMPLES - first,
+								frames[n_frames], mtu, &encoded);
+			bytes += lens[n_frames];
+			first += encoded;
+		}
+	}
+	encode_ns = (now_ns() - start) / iterations / SAMPLES;
+
+	start = now_ns();
+	for (long it = 0; it < iterations; it++) {
+		for (int f = 0; f < n_frames; f++) {
+			sink += telemetry_delta_decode(frames[f], lens[f], out,
+						       TELEMETRY_DELTA_MAX_RECORDS);
+		}
+	}
+	decode_ns = (now_ns() - start) / iterations / SAMPLES;
+
+	size_t per_batch = (mtu - BATCH_HEADER_SIZE) / BATCH_RECORD_SIZE;
+	size_t batch_frames = (SAMPLES + per_batch - 1) / per_batch;
+	size_t batch_bytes = batch_frames * BATCH_HEADER_SIZE + SAMPLES * BATCH_RECORD_SIZE;
+
+	printf("mtu %3zu: delta %2d frames %4zu B %5.2f B/sample | batch %2zu frames %4zu B "
+	       "%5.2f B/sample | telemetry %2d frames %4d B %5.2f B/sample | "
+	       "encode %6.1f ns/sample decode %6.1f ns/sample\n",
+	       mtu, n_frames, bytes, (double)bytes / SAMPLES, batch_frames, batch_bytes,
+	       (double)batch_bytes / SAMPLES, SAMPLES, SAMPLES * TELEMETRY_SIZE,
+	       (double)TELEMETRY_SIZE, encode_ns, decode_ns);
+}
+
+int main(int argc, char **argv)
+{
+	static const size_t mtus[] = { 19, 64, 255 };
+	struct telemetry_sample s[SAMPLES];
+	long iterations = (argc > 1) ? atol(argv[1]) : 100000;
+
+	if (iterations <= 0) {
+		fprintf(stderr, "iterations must be positive\n");
+		return 1;
+	}
+	make_samples(s, SAMPLES);
+	printf("%d samples, %ld iterations\n", SAMPLES, iterations);
+	for (size_t i = 0; i < sizeof(mtus) / sizeof(mtus[0]); i++) {
+		bench_mtu(s, mtus[i], iterations);
+	}
+	return 0;
+}
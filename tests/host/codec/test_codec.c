@@ -0,0 +1,216 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sidewalk/at_telemetry_codec.h>
+
+#include "host_test.h"
+
+#define FRAME_MAX 255
+
+static bool sample_eq(const struct telemetry_sample *a, const struct telemetry_sample *b)
+{
+	return a->batt == b->batt && a->temp == b->temp && a->hum == b->hum &&
+	       a->motion == b->motion && a->accel == b->accel;
+}
+
+/* Encode everything into frames of mtu bytes, decode them back and compare */
+static void round_trip(const struct telemetry_sample *samples, size_t count, size_t mtu)
+{
+	struct telemetry_sample out[TELEMETRY_DELTA_MAX_RECORDS];
+	uint8_t frame[FRAME_MAX];
+	size_t first = 0;
+
+	while (first < count) {
+		size_t encoded;
+		int len = telemetry_delta_encode(&samples[first], count - first, frame, mtu,
+						 &encoded);
+
+		CHECK(len > 0);
+		if (len <= 0) {
+			return;
+		}
+		CHECK((size_t)len <= mtu);
+		CHECK(encoded > 0);
+
+		int decoded = telemetry_delta_decode(frame, len, out, TELEMETRY_DELTA_MAX_RECORDS);
+
+		CHECK_EQ(decoded, encoded);
+		for (size_t i = 0; i < encoded && decoded > 0; i++) {
+			CHECK(sample_eq(&out[i], &samples[first + i]));
+		}
+		first += encoded;
+	}
+}
+
+static void test_single_sample(void)
+{
+	struct telemetry_sample s = { .batt = 87, .temp = 21, .hum = 45, .motion = true,
+				      .accel = 12 };
+
+	round_trip(&s, 1, FRAME_MAX);
+	round_trip(&s, 1, 6);
+}
+
+static void test_edge_values(void)
+{
+	struct telemetry_sample s[] = {
+		{ .batt = 0, .temp = -128, .hum = 0, .motion = false, .accel = 0 },
+		{ .batt = 100, .temp = 127, .hum = 100, .motion = true, .accel = 127 },
+		{ .batt = 127, .temp = -1, .hum = 127, .motion = false, .accel = 1 },
+		{ .batt = 0, .temp = 0, .hum = 0, .motion = true, .accel = 127 },
+		{ .batt = 0, .temp = 0, .hum = 0, .motion = true, .accel = 127 },
+	};
+
+	round_trip(s, sizeof(s) / sizeof(s[0]), FRAME_MAX);
+}
+
+/* Each delta class boundary: 0, -4..3, -32..31 and raw beyond */
+static void test_delta_boundaries(void)
+{
+	static const int deltas[] = { 0, 3, -4, 4, -5, 31, -32, 32, -33 };
+	struct telemetry_sample s[2 * (sizeof(deltas) / sizeof(deltas[0]))];
+	size_t n = 0;
+
+	for (size_t i = 0; i < sizeof(deltas) / sizeof(deltas[0]); i++) {
+		struct telemetry_sample base = { .batt = 50, .temp = 0, .hum = 50, .accel = 50 };
+		struct telemetry_sample next = base;
+
+		next.batt += deltas[i];
+		next.temp += deltas[i];
+		next.hum += deltas[i];
+		next.accel += deltas[i];
+		next.motion = i & 1;
+		s[n++] = base;
+		s[n++] = next;
+	}
+	round_trip(s, n, FRAME_MAX);
+}
+
+/* Deltas that overflow the field range must take the raw path */
+static void test_overflowing_deltas(void)
+{
+	struct telemetry_sample s[] = {
+		{ .batt = 0, .temp = -128, .hum = 0, .accel = 0 },
+		{ .batt = 100, .temp = 127, .hum = 100, .accel = 127 },
+		{ .batt = 0, .temp = -128, .hum = 0, .accel = 0 },
+		{ .batt = 100, .temp = 127, .hum = 100, .accel = 127 },
+	};
+
+	round_trip(s, sizeof(s) / sizeof(s[0]), FRAME_MAX);
+}
+
+static void test_random_split_frames(void)
+{
+	static const size_t mtus[] = { 6, 11, 19, 64, 255 };
+	struct telemetry_sample s[200];
+
+	srand(1);
+	for (size_t i = 0; i < sizeof(s) / sizeof(s[0]); i++) {
+		// Mostly slow drift with an occasional jump
+		if (i == 0 || rand() % 8 == 0) {
+			s[i] = (struct telemetry_sample){ .batt = rand() % 101,
+							  .temp = rand() % 256 - 128,
+							  .hum = rand() % 101,
+							  .motion = rand() & 1,
+							  .accel = rand() % 128 };
+		} else {
+			s[i] = s[i - 1];
+			s[i].temp += (s[i].temp < 120) ? rand() % 3 - 1 : -1;
+			s[i].hum = (s[i].hum + rand() % 3) % 101;
+			s[i].accel = rand() % 16;
+			s[i].motion = rand() & 1;
+		}
+	}
+	for (size_t i = 0; i < sizeof(mtus) / sizeof(mtus[0]); i++) {
+		round_trip(s, sizeof(s) / sizeof(s[0]), mtus[i]);
+	}
+}
+
+static void test_record_limit(void)
+{
+	struct telemetry_sample s[TELEMETRY_DELTA_MAX_RECORDS + 10] = { 0 };
+	uint8_t frame[FRAME_MAX];
+	size_t encoded;
+
+	int len = telemetry_delta_encode(s, sizeof(s) / sizeof(s[0]), frame, sizeof(frame),
+					 &encoded);
+
+	CHECK(len > 0);
+	CHECK_EQ(encoded, TELEMETRY_DELTA_MAX_RECORDS);
+}
+
+static void test_encode_errors(void)
+{
+	struct telemetry_sample s = { .batt = 1 };
+	uint8_t frame[FRAME_MAX];
+	size_t encoded = 99;
+
+	// Header only, and too short for the 30 bit absolute record
+	CHECK_EQ(telemetry_delta_encode(&s, 1, frame, 1, &encoded), -EINVAL);
+	CHECK_EQ(encoded, 0);
+	CHECK_EQ(telemetry_delta_encode(&s, 1, frame, 4, &encoded), -EINVAL);
+	CHECK_EQ(telemetry_delta_encode(&s, 0, frame, sizeof(frame), &encoded), -EINVAL);
+}
+
+/* A partially written record must not leave bits behind */
+static void test_partial_record_rollback(void)
+{
+	struct telemetry_sample s[] = {
+		{ .batt = 10, .temp = 10, .hum = 10, .accel = 10 },
+		{ .batt = 100, .temp = -100, .hum = 100, .accel = 100, .motion = true },
+	};
+	struct telemetry_sample out[2];
+	uint8_t frame[6];
+	size_t encoded;
+
+	memset(frame, 0xFF, sizeof(frame));
+	int len = telemetry_delta_encode(s, 2, frame, sizeof(frame), &encoded);
+
+	CHECK_EQ(encoded, 1);
+	CHECK_EQ(len, 5);
+	CHECK_EQ(frame[len - 1] & 0x03, 0);
+	CHECK_EQ(telemetry_delta_decode(frame, len, out, 2), 1);
+	CHECK(sample_eq(&out[0], &s[0]));
+}
+
+static void test_decode_errors(void)
+{
+	struct telemetry_sample s[4] = {
+		{ .batt = 1 }, { .batt = 50 }, { .batt = 2 }, { .batt = 3 },
+	};
+	struct telemetry_sample out[4];
+	uint8_t frame[FRAME_MAX];
+	size_t encoded;
+	int len = telemetry_delta_encode(s, 4, frame, sizeof(frame), &encoded);
+
+	CHECK_EQ(telemetry_delta_decode(frame, len, out, 3), -ENOMEM);
+	CHECK_EQ(telemetry_delta_decode(frame, 1, out, 4), -EINVAL);
+	CHECK_EQ(telemetry_delta_decode(frame, len - 1, out, 4), -EINVAL);
+
+	uint8_t header = frame[0];
+
+	frame[0] = (0x02 << 6) | 4;
+	CHECK_EQ(telemetry_delta_decode(frame, len, out, 4), -EINVAL);
+	frame[0] = (TELEMETRY_MSG_TYPE_DELTA << 6);
+	CHECK_EQ(telemetry_delta_decode(frame, len, out, 4), -EINVAL);
+	frame[0] = header;
+	CHECK_EQ(telemetry_delta_decode(frame, len, out, 4), 4);
+}
+
+int main(void)
+{
+	RUN_TEST(test_single_sample);
+	RUN_TEST(test_edge_values);
+	RUN_TEST(test_delta_boundaries);
+	RUN_TEST(test_overflowing_deltas);
+	RUN_TEST(test_random_split_frames);
+	RUN_TEST(test_record_limit);
+	RUN_TEST(test_encode_errors);
+	RUN_TEST(test_partial_record_rollback);
+	RUN_TEST(test_decode_errors);
+	return TEST_RESULT();
+}
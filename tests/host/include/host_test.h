@@ -0,0 +1,38 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+static int test_failures;
+
+#define CHECK(cond)                                                                        \
+	do {                                                                               \
+		if (!(cond)) {                                                             \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			test_failures++;                                                   \
+		}                                                                          \
+	} while (0)
+
+#define CHECK_EQ(a, b)                                                                     \
+	do {                                                                               \
+		long long _a = (a), _b = (b);                                              \
+		if (_a != _b) {                                                            \
+			fprintf(stderr, "%s:%d: %s == %s failed: %lld != %lld\n", __FILE__,  \
+				__LINE__, #a, #b, _a, _b);                                 \
+			test_failures++;                                                   \
+		}                                                                          \
+	} while (0)
+
+#define RUN_TEST(fn)                                                                       \
+	do {                                                                               \
+		int _before = test_failures;                                               \
+		fn();                                                                      \
+		printf("%s %s\n", (test_failures == _before) ? "PASS" : "FAIL", #fn);       \
+	} while (0)
+
+#define TEST_RESULT() (test_failures ? 1 : 0)
+
+#endif /* HOST_TEST_H */
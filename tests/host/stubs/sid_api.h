@@ -0,0 +1,73 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+/* Host test stand-in for the Sidewalk SDK header, only what the tests use */
+
+#ifndef SID_API_H
+#define SID_API_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sid_error.h>
+
+enum sid_link_type {
+	SID_LINK_TYPE_1 = 1 << 0,	// BLE
+	SID_LINK_TYPE_2 = 1 << 1,	// FSK
+	SID_LINK_TYPE_3 = 1 << 2,	// LoRa
+};
+#define SID_LINK_TYPE_MAX_IDX 3
+
+enum sid_time_sync_status {
+	SID_STATUS_NO_TIME,
+	SID_STATUS_TIME_SYNCED,
+};
+
+enum sid_msg_type {
+	SID_MSG_TYPE_GET,
+	SID_MSG_TYPE_SET,
+	SID_MSG_TYPE_NOTIFY,
+	SID_MSG_TYPE_RESPONSE,
+};
+
+enum sid_link_mode {
+	SID_LINK_MODE_CLOUD = 1,
+	SID_LINK_MODE_MOBILE = 2,
+};
+
+struct sid_handle;
+
+struct sid_event_callbacks {
+	void *context;
+};
+
+struct sid_config {
+	uint32_t link_mask;
+	const void *sub_ghz_link_config;
+};
+
+struct sid_msg {
+	void *data;
+	size_t size;
+};
+
+struct sid_msg_desc {
+	enum sid_msg_type type;
+	uint32_t link_type;
+	enum sid_link_mode link_mode;
+	uint16_t id;
+	struct {
+		struct {
+			bool request_ack;
+			uint8_t num_retries;
+			uint16_t ttl_in_seconds;
+		} tx_attr;
+	} msg_desc_attr;
+};
+
+sid_error_t sid_put_msg(struct sid_handle *handle, const struct sid_msg *msg,
+			struct sid_msg_desc *msg_desc);
+sid_error_t sid_get_mtu(struct sid_handle *handle, enum sid_link_type link_type, size_t *mtu);
+
+#endif /* SID_API_H */
@@ -0,0 +1,17 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+/* Host test stand-in for the Sidewalk SDK header, only what the tests use */
+
+#ifndef SID_ERROR_H
+#define SID_ERROR_H
+
+typedef enum {
+	SID_ERROR_NONE = 0,
+	SID_ERROR_GENERIC = -1,
+	SID_ERROR_INVALID_ARGS = -3,
+	SID_ERROR_NOT_FOUND = -14,
+	SID_ERROR_NO_PERMISSION = -25,
+} sid_error_t;
+
+#endif /* SID_ERROR_H */
@@ -0,0 +1,86 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+/*
+ * Host test stand-in for the Zephyr kernel API, only what the tests use.
+ * Time is driven by the test through host_uptime_ms.
+ */
+
+#ifndef ZEPHYR_KERNEL_H_
+#define ZEPHYR_KERNEL_H_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/sys/util.h>
+
+#define MSEC_PER_SEC 1000
+
+typedef struct {
+	int64_t ms;
+} k_timeout_t;
+
+#define K_MSEC(ms) ((k_timeout_t){ (ms) })
+#define K_SECONDS(s) K_MSEC((int64_t)(s) * 1000)
+#define K_NO_WAIT K_MSEC(0)
+
+extern uint32_t host_uptime_ms;
+
+static inline uint32_t k_uptime_get_32(void)
+{
+	return host_uptime_ms;
+}
+
+static inline int64_t k_uptime_get(void)
+{
+	return host_uptime_ms;
+}
+
+static inline uint32_t k_cycle_get_32(void)
+{
+	return host_uptime_ms;
+}
+
+/* Fixed block allocator with the k_mem_slab interface */
+struct k_mem_slab {
+	size_t block_size;
+	uint32_t num_blocks;
+	uint32_t used_mask;
+	char *buffer;
+};
+
+#define K_MEM_SLAB_DEFINE_STATIC(name, size, count, align)                                  \
+	static char __aligned(align) _slab_buf_##name[(count) * (size)];                     \
+	static struct k_mem_slab name = { (size), (count), 0, _slab_buf_##name }
+
+static inline int k_mem_slab_alloc(struct k_mem_slab *slab, void **mem, k_timeout_t timeout)
+{
+	(void)timeout;
+	for (uint32_t i = 0; i < slab->num_blocks; i++) {
+		if ((slab->used_mask & BIT(i)) == 0) {
+			slab->used_mask |= BIT(i);
+			*mem = slab->buffer + i * slab->block_size;
+			return 0;
+		}
+	}
+	*mem = NULL;
+	return -ENOMEM;
+}
+
+static inline void k_mem_slab_free(struct k_mem_slab *slab, void *mem)
+{
+	uint32_t i = ((char *)mem - slab->buffer) / slab->block_size;
+
+	slab->used_mask &= ~BIT(i);
+}
+
+static inline uint32_t k_mem_slab_num_used_get(struct k_mem_slab *slab)
+{
+	return __builtin_popcount(slab->used_mask);
+}
+
+#endif /* ZEPHYR_KERNEL_H_ */
@@ -0,0 +1,15 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef ZEPHYR_LOGGING_LOG_H_
+#define ZEPHYR_LOGGING_LOG_H_
+
+#define LOG_MODULE_REGISTER(...)
+#define LOG_ERR(...) ((void)0)
+#define LOG_WRN(...) ((void)0)
+#define LOG_INF(...) ((void)0)
+#define LOG_DBG(...) ((void)0)
+#define LOG_HEXDUMP_DBG(...) ((void)0)
+#define LOG_HEXDUMP_INF(...) ((void)0)
+
+#endif /* ZEPHYR_LOGGING_LOG_H_ */
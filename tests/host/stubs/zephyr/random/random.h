@@ -0,0 +1,11 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef ZEPHYR_RANDOM_RANDOM_H_
+#define ZEPHYR_RANDOM_RANDOM_H_
+
+#include <stdint.h>
+
+uint32_t sys_rand32_get(void);
+
+#endif /* ZEPHYR_RANDOM_RANDOM_H_ */
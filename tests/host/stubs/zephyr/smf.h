@@ -0,0 +1,11 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef ZEPHYR_SMF_H_
+#define ZEPHYR_SMF_H_
+
+struct smf_ctx {
+	const void *current;
+};
+
+#endif /* ZEPHYR_SMF_H_ */
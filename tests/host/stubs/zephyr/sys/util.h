@@ -0,0 +1,33 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+#ifndef ZEPHYR_SYS_UTIL_H_
+#define ZEPHYR_SYS_UTIL_H_
+
+#include <stdint.h>
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define CLAMP(val, low, high) (((val) <= (low)) ? (low) : MIN(val, high))
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define BIT(n) (1U << (n))
+#define BIT64(n) (1ULL << (n))
+/* 32 bit like the nRF52, so out of range shifts show up as on target */
+#define GENMASK(h, l) (((~0U) - (1U << (l)) + 1) & (~0U >> (32 - 1 - (h))))
+#define GENMASK64(h, l) (((~0ULL) - (1ULL << (l)) + 1) & (~0ULL >> (64 - 1 - (h))))
+#define IS_ENABLED(config) (config + 0)
+#define ARG_UNUSED(x) (void)(x)
+#define __aligned(x) __attribute__((__aligned__(x)))
+
+static inline unsigned int find_lsb_set(uint32_t op)
+{
+	return __builtin_ffs(op);
+}
+
+static inline int u64_count_trailing_zeros(uint64_t value)
+{
+	return value == 0 ? 64 : __builtin_ctzll(value);
+}
+
+#endif /* ZEPHYR_SYS_UTIL_H_ */
@@ -0,0 +1,706 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+/*
+ * Telemetry packing and delivery of at_uplink.c against a fake Sidewalk stack.
+ * Samples carry a sequence number in the temperature field so every frame
+ * can be decoded and checked for loss, duplication and order.
+ */
+
+#include <zephyr/kernel.h>
+
+#include <asset_tracker.h>
+#include <sidewalk/at_uplink.h>
+#include <sidewalk/at_telemetry_codec.h>
+#include <peripherals/at_sensors.h>
+#include <peripherals/at_storage.h>
+#include <peripherals/at_timers.h>
+
+#include "host_test.h"
+
+#define PUTS_MAX 256
+#define EVENTS_MAX 64
+#define LOG_MAX 256
+
+uint32_t host_uptime_ms;
+
+/* Fake Sidewalk stack */
+struct put_rec {
+	uint16_t id;
+	uint32_t link;
+	bool ack;
+	bool resolved;
+	size_t size;
+	uint8_t data[UPLINK_MTU_MAX];
+};
+
+static struct put_rec sent[PUTS_MAX];
+static int put_count;
+static int put_failures;	// next sid_put_msg calls that fail
+static size_t link_mtu[3];	// BLE, FSK, LoRa, 0 if sid_get_mtu fails
+
+sid_error_t sid_put_msg(struct sid_handle *handle, const struct sid_msg *msg,
+			struct sid_msg_desc *msg_desc)
+{
+	if (put_failures > 0) {
+		put_failures--;
+		return SID_ERROR_NO_PERMISSION;
+	}
+	if (put_count == PUTS_MAX) {
+		return SID_ERROR_GENERIC;
+	}
+
+	struct put_rec *rec = &sent[put_count++];
+
+	*rec = (struct put_rec){
+		.id = put_count,
+		.link = msg_desc->link_type,
+		.ack = msg_desc->msg_desc_attr.tx_attr.request_ack,
+		.size = msg->size,
+	};
+	memcpy(rec->data, msg->data, msg->size);
+	msg_desc->id = rec->id;
+	return SID_ERROR_NONE;
+}
+
+sid_error_t sid_get_mtu(struct sid_handle *handle, enum sid_link_type link_type, size_t *mtu)
+{
+	int idx = __builtin_ctz(link_type);
+
+	if (link_mtu[idx] == 0) {
+		return SID_ERROR_NOT_FOUND;
+	}
+	*mtu = link_mtu[idx];
+	return SID_ERROR_NONE;
+}
+
+uint32_t sys_rand32_get(void)
+{
+	return 0;
+}
+
+#if defined(CONFIG_TELEMETRY_DELTA_ENCODING)
+/* Delta encoder, wrapped at link time to fail on request */
+static int encode_ok;		// telemetry_delta_encode calls before one fails, -1 never
+
+int __real_telemetry_delta_encode(const struct telemetry_sample *samples, size_t count,
+				  uint8_t *buf, size_t buf_size, size_t *encoded);
+
+int __wrap_telemetry_delta_encode(const struct telemetry_sample *samples, size_t count,
+				  uint8_t *buf, size_t buf_size, size_t *encoded)
+{
+	if (encode_ok == 0) {
+		encode_ok = -1;
+		*encoded = 0;
+		return -EINVAL;
+	}
+	if (encode_ok > 0) {
+		encode_ok--;
+	}
+	return __real_telemetry_delta_encode(samples, count, buf, buf_size, encoded);
+}
+#endif
+
+/* Tracker events */
+static at_event_t events[EVENTS_MAX];
+static int event_head, event_tail;
+
+void at_event_send(at_event_t event)
+{
+	events[event_tail++ % EVENTS_MAX] = event;
+}
+
+static bool event_pop(at_event_t *event)
+{
+	if (event_head == event_tail) {
+		return false;
+	}
+	*event = events[event_head++ % EVENTS_MAX];
+	return true;
+}
+
+/* Timers */
+static bool retry_armed;
+static uint32_t retry_at;
+
+void uplink_retry_timer_set_and_run(k_timeout_t delay)
+{
+	retry_armed = true;
+	retry_at = host_uptime_ms + delay.ms;
+}
+
+void uplink_retry_timer_stop(void)
+{
+	retry_armed = false;
+}
+
+static bool drain_armed;
+
+void storage_drain_timer_set_and_run(k_timeout_t delay)
+{
+	drain_armed = true;
+}
+
+uint32_t at_sensors_agg_take(struct at_sensor_agg *agg)
+{
+	return 0;
+}
+
+/* In-memory telemetry log */
+static struct telemetry_sample log_buf[LOG_MAX];
+static uint32_t log_head, log_tail;
+
+int at_storage_append(const struct telemetry_sample *sample)
+{
+	if (log_tail - log_head == LOG_MAX) {
+		log_head++;
+	}
+	log_buf[log_tail++ % LOG_MAX] = *sample;
+	return 0;
+}
+
+int at_storage_peek(struct telemetry_sample *samples, size_t max)
+{
+	size_t n = MIN(max, log_tail - log_head);
+
+	for (size_t i = 0; i < n; i++) {
+		samples[i] = log_buf[(log_head + i) % LOG_MAX];
+	}
+	return n;
+}
+
+int at_storage_consume(size_t count)
+{
+	log_head += MIN(count, log_tail - log_head);
+	return 0;
+}
+
+uint32_t at_storage_backlog(void)
+{
+	return log_tail - log_head;
+}
+
+/* Test fixture */
+static at_ctx_t ctx;
+static int next_seq;
+static bool seen[128];
+static int delivered;
+static int drain_events;
+
+static void reset(uint32_t configured, uint32_t up)
+{
+	at_event_t event;
+
+	// Settle anything left over from the previous test
+	at_uplink_abort(&ctx);
+	while (event_pop(&event)) {
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.sidewalk_state = STATE_SIDEWALK_READY;
+	ctx.at_conf.sid_link_type = configured;
+	ctx.at_conf.batch_size = 1;
+	ctx.link_status.link_status_mask = up;
+	link_mtu[0] = 255;
+	link_mtu[1] = 200;
+	link_mtu[2] = MAX_PAYLOAD_SIZE;
+	put_count = 0;
+	put_failures = 0;
+#if defined(CONFIG_TELEMETRY_DELTA_ENCODING)
+	encode_ok = -1;
+#endif
+	retry_armed = false;
+	drain_armed = false;
+	log_head = log_tail = 0;
+	next_seq = 0;
+	delivered = 0;
+	drain_events = 0;
+	memset(seen, 0, sizeof(seen));
+}
+
+static struct telemetry_sample make_sample(void)
+{
+	return (struct telemetry_sample){ .batt = 90, .temp = next_seq++, .hum = 40 };
+}
+
+static void add_sample(void)
+{
+	struct telemetry_sample s = make_sample();
+
+	ctx.sensors.batt = s.batt;
+	ctx.sensors.temp_mc = s.temp * 1000;
+	ctx.sensors.hum_mpct = s.hum * 1000;
+	CHECK(at_uplink_sample(&ctx));
+}
+
+static void add_backlog(int count)
+{
+	for (int i = 0; i < count; i++) {
+		struct telemetry_sample s = make_sample();
+
+		at_storage_append(&s);
+	}
+}
+
+/* Decode a frame and mark its samples delivered */
+static void frame_check(const struct put_rec *rec)
+{
+	struct telemetry_sample out[TELEMETRY_DELTA_MAX_RECORDS];
+	const uint8_t *f = rec->data;
+	int n = 0;
+
+	switch (f[0] >> 6) {
+	case 0x01:
+		CHECK_EQ(rec->size, 5);
+		out[0] = (struct telemetry_sample){ .batt = f[1], .temp = (int8_t)f[2], .hum = f[3] };
+		n = 1;
+		break;
+	case 0x02:
+		n = f[0] & 0x3F;
+		CHECK_EQ(rec->size, 1 + 4 * n);
+		for (int i = 0; i < n; i++) {
+			out[i] = (struct telemetry_sample){ .batt = f[1 + 4 * i],
+							    .temp = (int8_t)f[2 + 4 * i],
+							    .hum = f[3 + 4 * i] };
+		}
+		break;
+	case TELEMETRY_MSG_TYPE_DELTA:
+		n = telemetry_delta_decode(f, rec->size, out, TELEMETRY_DELTA_MAX_RECORDS);
+		CHECK(n > 0);
+		break;
+	case 0x00:
+		if ((f[0] & 0x3F) != 0x01) {
+			return;
+		}
+		// LOCATION_BUNDLE, the telemetry frame follows the scan result
+		CHECK_EQ(rec->size, 3 + f[2] + 5);
+		f += 3 + f[2];
+		CHECK_EQ(f[0], 0x40);
+		out[0] = (struct telemetry_sample){ .batt = f[1], .temp = (int8_t)f[2], .hum = f[3] };
+		n = 1;
+		break;
+	default:
+		return;
+	}
+	for (int i = 0; i < n; i++) {
+		CHECK(out[i].temp >= 0 && out[i].temp < next_seq);
+		CHECK_EQ(out[i].batt, 90);
+		if (out[i].temp >= 0) {
+			// A frame may be sent twice after a failure, but not lost
+			delivered += !seen[out[i].temp];
+			seen[out[i].temp] = true;
+		}
+	}
+}
+
+/*
+ * Run the tracker side until the uplink completes, reporting each queued
+ * frame sent, or failed when fail is set for it
+ */
+static bool run_uplink(bool (*fail)(const struct put_rec *rec))
+{
+	at_event_t event;
+	bool complete = false;
+
+	at_send_uplink(&ctx);
+	for (int guard = 0; guard < 10000 && !complete; guard++) {
+		if (event_pop(&event)) {
+			switch (event) {
+			case EVENT_SEND_UPLINK:
+			case EVENT_UPLINK_RETRY:
+				at_send_uplink(&ctx);
+				break;
+			case EVENT_UPLINK_COMPLETE:
+				complete = true;
+				break;
+			case EVENT_STORAGE_DRAIN:
+				drain_events++;
+				break;
+			default:
+				break;
+			}
+			continue;
+		}
+
+		struct put_rec *rec = NULL;
+
+		for (int i = 0; i < put_count; i++) {
+			if (!sent[i].resolved) {
+				rec = &sent[i];
+				break;
+			}
+		}
+		if (rec != NULL) {
+			struct sid_msg_desc desc = { .id = rec->id, .link_type = rec->link };
+
+			rec->resolved = true;
+			if (fail != NULL && fail(rec)) {
+				at_send_error(&ctx, &desc);
+			} else {
+				frame_check(rec);
+				at_msg_sent(&ctx, &desc);
+			}
+		} else if (retry_armed) {
+			host_uptime_ms = retry_at;
+			retry_armed = false;
+			at_event_send(EVENT_UPLINK_RETRY);
+		} else {
+			break;
+		}
+	}
+	return complete;
+}
+
+/* Drain the log the way EVENT_STORAGE_DRAIN does, returns the uplinks used */
+static int drain_all(void)
+{
+	int uplinks = 0;
+
+	while (at_storage_backlog() > 0 && uplinks < 100) {
+		ctx.uplink_drain = true;
+		CHECK(run_uplink(NULL));
+		ctx.uplink_drain = false;
+		uplinks++;
+	}
+	return uplinks;
+}
+
+static void check_frames(int first, uint32_t link, size_t mtu)
+{
+	for (int i = first; i < put_count; i++) {
+		CHECK_EQ(sent[i].link, link);
+		CHECK(sent[i].size <= mtu);
+	}
+}
+
+static void test_lora_up_only(void)
+{
+	reset(BLE_LM | LORA_LM, LORA_LM);
+	add_backlog(30);
+	add_sample();
+	CHECK(run_uplink(NULL));
+	drain_all();
+
+	check_frames(0, LORA_LM, MAX_PAYLOAD_SIZE);
+	CHECK_EQ(delivered, 31);
+	CHECK_EQ(at_storage_backlog(), 0);
+}
+
+/* With BLE connected the backlog goes out in BLE sized frames, over BLE */
+static void test_ble_up_uses_ble_mtu(void)
+{
+	int lora_puts;
+
+	reset(BLE_LM | LORA_LM, LORA_LM);
+	add_backlog(30);
+	add_sample();
+	CHECK(run_uplink(NULL));
+	drain_all();
+	lora_puts = put_count;
+
+	reset(BLE_LM | LORA_LM, BLE_LM | LORA_LM);
+	add_backlog(30);
+	add_sample();
+	CHECK(run_uplink(NULL));
+	drain_all();
+
+	check_frames(0, BLE_LM, 255);
+	CHECK_EQ(delivered, 31);
+	CHECK_EQ(at_storage_backlog(), 0);
+	// One BLE frame carries what takes several LoRa frames
+	CHECK_EQ(put_count, 1);
+	CHECK(lora_puts > put_count);
+	printf("  31 samples: %d LoRa frames, %d BLE frames\n", lora_puts, put_count);
+}
+
+static void test_no_link_up_fits_every_link(void)
+{
+	reset(BLE_LM | LORA_LM, 0);
+	add_backlog(10);
+	add_sample();
+	CHECK(run_uplink(NULL));
+
+	check_frames(0, BLE_LM | LORA_LM, MAX_PAYLOAD_SIZE);
+	CHECK(delivered > 1);
+}
+
+static void test_mtu_unknown_falls_back_to_lora(void)
+{
+	reset(BLE_LM, BLE_LM);
+	link_mtu[0] = 0;
+	add_backlog(10);
+	add_sample();
+	CHECK(run_uplink(NULL));
+	drain_all();
+
+	check_frames(0, BLE_LM, MAX_PAYLOAD_SIZE);
+	CHECK_EQ(delivered, 11);
+}
+
+/* Below the smallest frame nothing is sent and the sample is kept */
+static void test_tiny_mtu_holds_samples(void)
+{
+	reset(LORA_LM, LORA_LM);
+	link_mtu[2] = 4;
+	add_sample();
+	CHECK(run_uplink(NULL));
+
+	CHECK_EQ(put_count, 0);
+	CHECK_EQ(at_storage_backlog(), 1);
+	// A drain would meet the same MTU, none is scheduled
+	CHECK(!drain_armed);
+	CHECK_EQ(drain_events, 0);
+}
+
+static bool fail_all(const struct put_rec *rec)
+{
+	return true;
+}
+
+/* Samples stored after a failure while the link stays up get a later drain */
+static void test_failed_batch_schedules_drain(void)
+{
+	reset(LORA_LM, LORA_LM);
+	add_sample();
+	CHECK(run_uplink(fail_all));
+
+	CHECK_EQ(at_storage_backlog(), 1);
+	CHECK(drain_armed);
+	CHECK_EQ(drain_events, 0);
+
+	// The link went down meanwhile, the READY edge drains instead
+	reset(LORA_LM, LORA_LM);
+	add_sample();
+	at_send_uplink(&ctx);
+	ctx.sidewalk_state = STATE_SIDEWALK_NOT_READY;
+	at_uplink_abort(&ctx);
+	CHECK_EQ(at_storage_backlog(), 1);
+	CHECK(!drain_armed);
+
+	// The drain delivers them
+	reset(LORA_LM, LORA_LM);
+	add_backlog(3);
+	drain_all();
+	CHECK_EQ(delivered, 3);
+	CHECK(!drain_armed);
+}
+
+/* Every frame at a small MTU still fits, including single sample frames */
+static void test_small_mtu_frames_fit(void)
+{
+	for (size_t mtu = 5; mtu <= 24; mtu++) {
+		reset(LORA_LM, LORA_LM);
+		link_mtu[2] = mtu;
+		add_backlog(20);
+		add_sample();
+		CHECK(run_uplink(NULL));
+		drain_all();
+
+		check_frames(0, LORA_LM, mtu);
+		CHECK_EQ(delivered, 21);
+	}
+}
+
+static const uint8_t scan[] = { 0x07, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14 };
+
+/* A scan result and the sample share one framed LOCATION_BUNDLE message */
+static void test_bundle_frame(void)
+{
+	reset(BLE_LM, BLE_LM);
+	CHECK(at_uplink_bundle(&ctx, scan, sizeof(scan), 3));
+	add_sample();
+	CHECK(run_uplink(NULL));
+
+	CHECK_EQ(put_count, 1);
+	CHECK_EQ(sent[0].size, 3 + sizeof(scan) + 5);
+	CHECK_EQ(sent[0].data[0], 0x01);
+	CHECK_EQ(sent[0].data[1], 3);
+	CHECK_EQ(sent[0].data[2], sizeof(scan));
+	CHECK(memcmp(&sent[0].data[3], scan, sizeof(scan)) == 0);
+	CHECK_EQ(delivered, 1);
+	CHECK_EQ(at_uplink_bundle_result(), 0);
+	CHECK_EQ(at_uplink_bundle_result(), -ENOENT);
+
+	// Used once, the next uplink is plain telemetry
+	add_sample();
+	CHECK(run_uplink(NULL));
+	CHECK_EQ(put_count, 2);
+	CHECK_EQ(sent[1].size, 5);
+}
+
+/* Anything else for the uplink to carry keeps the location send separate */
+static void test_bundle_refused(void)
+{
+	// Does not fit a LoRa frame
+	reset(LORA_LM, LORA_LM);
+	CHECK(!at_uplink_bundle(&ctx, scan, sizeof(scan), 3));
+
+	// Stored samples are waiting
+	reset(BLE_LM, BLE_LM);
+	add_backlog(1);
+	CHECK(!at_uplink_bundle(&ctx, scan, sizeof(scan), 3));
+
+	// Batching
+	reset(BLE_LM, BLE_LM);
+	ctx.at_conf.batch_size = 2;
+	CHECK(!at_uplink_bundle(&ctx, scan, sizeof(scan), 3));
+
+	// Not ready, the sample goes to flash
+	reset(BLE_LM, BLE_LM);
+	ctx.sidewalk_state = STATE_SIDEWALK_NOT_READY;
+	CHECK(!at_uplink_bundle(&ctx, scan, sizeof(scan), 3));
+}
+
+/* A bundle dropped by an abort does not leak into the next uplink */
+static void test_bundle_cleared_on_abort(void)
+{
+	reset(BLE_LM, BLE_LM);
+	CHECK(at_uplink_bundle(&ctx, scan, sizeof(scan), 3));
+	CHECK_EQ(at_uplink_bundle_result(), -EINPROGRESS);
+	at_uplink_abort(&ctx);
+	CHECK_EQ(at_uplink_bundle_result(), -EIO);
+	add_sample();
+	CHECK(run_uplink(NULL));
+	CHECK_EQ(put_count, 1);
+	CHECK_EQ(sent[0].size, 5);
+	CHECK_EQ(at_uplink_bundle_result(), -ENOENT);
+}
+
+/* A bundle whose frame is not delivered reports the location as lost */
+static void test_bundle_failed(void)
+{
+	reset(BLE_LM, BLE_LM);
+	CHECK(at_uplink_bundle(&ctx, scan, sizeof(scan), 3));
+	add_sample();
+	CHECK(run_uplink(fail_all));
+	CHECK_EQ(at_uplink_bundle_result(), -EIO);
+
+	// The link went down before the uplink, the sample goes to flash
+	reset(BLE_LM, BLE_LM);
+	CHECK(at_uplink_bundle(&ctx, scan, sizeof(scan), 3));
+	add_sample();
+	ctx.sidewalk_state = STATE_SIDEWALK_NOT_READY;
+	CHECK(run_uplink(NULL));
+	CHECK_EQ(at_uplink_bundle_result(), -EIO);
+}
+
+static bool fail_first(const struct put_rec *rec)
+{
+	return rec->id == 1;
+}
+
+/* Only a send the stack accepted counts as a radio session */
+static void test_radio_sessions(void)
+{
+	// Several frames and a retry are one session
+	reset(LORA_LM, LORA_LM);
+	ctx.at_conf.uplink_ack = true;
+	ctx.at_conf.uplink_retries = 2;
+	add_backlog(10);
+	add_sample();
+	CHECK(run_uplink(fail_first));
+	CHECK(put_count > 1);
+	CHECK_EQ(ctx.cycle.radio_sessions, 1);
+
+	// Stored because the link is down
+	reset(LORA_LM, 0);
+	ctx.sidewalk_state = STATE_SIDEWALK_NOT_READY;
+	add_sample();
+	CHECK(run_uplink(NULL));
+	CHECK_EQ(ctx.cycle.radio_sessions, 0);
+
+	// Drain of an empty log
+	reset(LORA_LM, LORA_LM);
+	ctx.uplink_drain = true;
+	CHECK(run_uplink(NULL));
+	CHECK_EQ(ctx.cycle.radio_sessions, 0);
+
+	// Every put refused
+	reset(LORA_LM, LORA_LM);
+	add_sample();
+	put_failures = 1;
+	CHECK(run_uplink(NULL));
+	CHECK_EQ(ctx.cycle.radio_sessions, 0);
+}
+
+/* A frame the stack refuses is retried like one that failed on air */
+static void test_put_refused_retried(void)
+{
+	struct at_uplink_stats stats;
+
+	reset(LORA_LM, LORA_LM);
+	ctx.at_conf.uplink_ack = true;
+	ctx.at_conf.uplink_retries = 2;
+	add_backlog(10);
+	add_sample();
+	put_failures = 2;
+	CHECK(run_uplink(NULL));
+	drain_all();
+	at_uplink_stats_get(&stats);
+	CHECK_EQ(delivered, 11);
+	CHECK_EQ(at_storage_backlog(), 0);
+	CHECK(stats.retries >= 2);
+
+	// Out of retries, the samples go back to flash
+	reset(LORA_LM, LORA_LM);
+	ctx.at_conf.uplink_ack = true;
+	ctx.at_conf.uplink_retries = 2;
+	add_sample();
+	put_failures = 3;
+	CHECK(run_uplink(NULL));
+	CHECK_EQ(put_count, 0);
+	CHECK_EQ(at_storage_backlog(), 1);
+	CHECK(drain_armed);
+}
+
+#if defined(CONFIG_TELEMETRY_DELTA_ENCODING)
+/* A delta encoding error sends the rest of the batch as SENSOR_BATCH frames */
+static void test_delta_error_falls_back(void)
+{
+	struct at_uplink_stats before, after;
+	int delta = 0, plain = 0;
+
+	reset(LORA_LM, LORA_LM);
+	link_mtu[2] = 6;
+	add_backlog(20);
+	add_sample();
+	CHECK(run_uplink(NULL));
+	at_uplink_stats_get(&before);
+	encode_ok = 1;
+	drain_all();
+	at_uplink_stats_get(&after);
+
+	CHECK_EQ(encode_ok, -1);
+	CHECK_EQ(after.encode_fallbacks, before.encode_fallbacks + 1);
+	check_frames(0, LORA_LM, 6);
+	for (int i = 0; i < put_count; i++) {
+		delta += (sent[i].data[0] >> 6) == TELEMETRY_MSG_TYPE_DELTA;
+		plain += (sent[i].data[0] >> 6) == 0x02;
+	}
+	CHECK(delta > 0);
+	CHECK(plain > 0);
+	CHECK_EQ(delivered, 21);
+	CHECK_EQ(at_storage_backlog(), 0);
+}
+#endif
+
+int main(void)
+{
+	RUN_TEST(test_lora_up_only);
+	RUN_TEST(test_ble_up_uses_ble_mtu);
+	RUN_TEST(test_no_link_up_fits_every_link);
+	RUN_TEST(test_mtu_unknown_falls_back_to_lora);
+	RUN_TEST(test_tiny_mtu_holds_samples);
+	RUN_TEST(test_small_mtu_frames_fit);
+	RUN_TEST(test_failed_batch_schedules_drain);
+	RUN_TEST(test_bundle_frame);
+	RUN_TEST(test_bundle_refused);
+	RUN_TEST(test_bundle_cleared_on_abort);
+	RUN_TEST(test_bundle_failed);
+	RUN_TEST(test_radio_sessions);
+	RUN_TEST(test_put_refused_retried);
+#if defined(CONFIG_TELEMETRY_DELTA_ENCODING)
+	RUN_TEST(test_delta_error_falls_back);
+#endif
+	return TEST_RESULT();
+}
@@ -0,0 +1,114 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+/*
+ * WiFi scene comparison. Scenes are built from access point numbers, each
+ * one a 7 byte RSSI + BSSID record behind a 1 byte header.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+#include <at_wifi_fingerprint.h>
+
+#include "host_test.h"
+
+#define MIN_MS (60 * 1000)
+
+uint32_t host_uptime_ms;
+
+struct scene {
+	uint8_t data[1 + 7 * WIFI_FP_MAX_AP];
+	size_t size;
+};
+
+/* Access points first..first+count-1 */
+static struct scene make_scene(int first, int count)
+{
+	struct scene s = { .size = 1 + 7 * count };
+
+	for (int i = 0; i < count; i++) {
+		uint8_t *ap = &s.data[1 + 7 * i];
+
+		ap[0] = 0xC0;
+		ap[1] = 0x02;
+		ap[6] = first + i;
+	}
+	return s;
+}
+
+static bool unchanged(const struct scene *s)
+{
+	return at_wifi_fp_unchanged(s->data, s->size);
+}
+
+static void sent(const struct scene *s, bool wifi)
+{
+	at_wifi_fp_sent(s->data, s->size, wifi);
+}
+
+/* 1 AP in 10 changes per scan: each scan is 81% like the one before */
+static void test_drift_is_sent(void)
+{
+	struct scene s = make_scene(0, 10);
+	int suppressed = 0;
+	int step;
+
+	host_uptime_ms += 2 * 60 * MIN_MS;
+	sent(&s, true);
+	for (step = 1; step <= 10; step++) {
+		s = make_scene(step, 10);
+		host_uptime_ms += MIN_MS / 10;
+		if (!unchanged(&s)) {
+			break;
+		}
+		suppressed++;
+	}
+	// 8 of 10 shared is 66%, below the 70% threshold
+	CHECK_EQ(suppressed, 1);
+	CHECK_EQ(step, 2);
+
+	// The sent scene is the new reference
+	sent(&s, true);
+	s = make_scene(3, 10);
+	CHECK(unchanged(&s));
+}
+
+/* Only WiFi sends restart the resend interval or set the reference */
+static void test_gnss_send_keeps_wifi_state(void)
+{
+	struct scene wifi = make_scene(20, 8);
+	struct scene gnss = make_scene(60, 8);
+
+	host_uptime_ms += 2 * 60 * MIN_MS;
+	sent(&wifi, true);
+	host_uptime_ms += 50 * MIN_MS;
+	CHECK(unchanged(&wifi));
+
+	sent(&gnss, false);
+	CHECK(unchanged(&wifi));
+
+	// Past the interval since the WiFi send, even with a recent GNSS send
+	host_uptime_ms += 11 * MIN_MS;
+	sent(&gnss, false);
+	CHECK(!unchanged(&wifi));
+}
+
+static void test_empty_scan_not_suppressed(void)
+{
+	struct scene s = make_scene(40, 6);
+	struct scene none = { .size = 1 };
+
+	host_uptime_ms += 2 * 60 * MIN_MS;
+	sent(&s, true);
+	CHECK(!unchanged(&none));
+}
+
+int main(void)
+{
+	RUN_TEST(test_drift_is_sent);
+	RUN_TEST(test_gnss_send_keeps_wifi_state);
+	RUN_TEST(test_empty_scan_not_suppressed);
+	return TEST_RESULT();
+}
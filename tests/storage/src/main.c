@@ -0,0 +1,179 @@
+// Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+// SPDX-License-Identifier: MIT-0
+
+/*
+ * Telemetry log on the native_sim flash simulator. Each sample carries a
+ * 16-bit sequence number in its batt and hum fields, so order, loss and
+ * recovery after a reset can be checked from the samples alone.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/storage/flash_map.h>
+
+#include "peripherals/at_storage.h"
+
+#define RECORD_SIZE 32
+#define SECTOR_RECORDS (4096 / RECORD_SIZE)
+
+static const struct flash_area *fa;
+static uint16_t seq;
+
+static int append(int count)
+{
+	for (int i = 0; i < count; i++) {
+		struct telemetry_sample s = { .batt = seq & 0xFF, .hum = seq >> 8 };
+		int err = at_storage_append(&s);
+
+		if (err) {
+			return err;
+		}
+		seq++;
+	}
+	return 0;
+}
+
+static uint16_t sample_seq(const struct telemetry_sample *s)
+{
+	return s->batt | (s->hum << 8);
+}
+
+/* Oldest pending sequence number, the log must not be empty */
+static uint16_t first_seq(void)
+{
+	struct telemetry_sample s;
+
+	zassert_equal(at_storage_peek(&s, 1), 1);
+	return sample_seq(&s);
+}
+
+static void *storage_setup(void)
+{
+	zassert_ok(flash_area_open(FIXED_PARTITION_ID(telemetry_log_partition), &fa));
+	return NULL;
+}
+
+static void storage_before(void *fixture)
+{
+	zassert_ok(flash_area_erase(fa, 0, fa->fa_size));
+	zassert_ok(init_at_storage());
+	zassert_equal(at_storage_backlog(), 0);
+	seq = 0;
+}
+
+ZTEST(at_storage, test_append_peek_consume_in_order)
+{
+	struct telemetry_sample s[10];
+
+	zassert_ok(append(10));
+	zassert_equal(at_storage_backlog(), 10);
+	zassert_equal(at_storage_peek(s, ARRAY_SIZE(s)), 10);
+	for (int i = 0; i < 10; i++) {
+		zassert_equal(sample_seq(&s[i]), i);
+	}
+
+	zassert_ok(at_storage_consume(4));
+	zassert_equal(at_storage_backlog(), 6);
+	zassert_equal(first_seq(), 4);
+
+	zassert_ok(at_storage_consume(6));
+	zassert_equal(at_storage_backlog(), 0);
+	zassert_equal(at_storage_peek(s, ARRAY_SIZE(s)), 0);
+}
+
+ZTEST(at_storage, test_recover_after_reset)
+{
+	zassert_ok(append(10));
+	zassert_ok(at_storage_consume(3));
+
+	zassert_ok(init_at_storage());
+	zassert_equal(at_storage_backlog(), 7);
+	zassert_equal(first_seq(), 3);
+
+	// Appends continue after the recovered head
+	zassert_ok(append(1));
+	zassert_ok(at_storage_consume(7));
+	zassert_equal(at_storage_backlog(), 1);
+	zassert_equal(first_seq(), 10);
+}
+
+ZTEST(at_storage, test_torn_record_skipped)
+{
+	static const uint8_t torn[8] = { 5, 0, 0, 0, 0x4c, 0x54, 0x01 };
+	struct at_storage_stats before, after;
+	struct telemetry_sample s[8];
+
+	zassert_ok(append(5));
+	// A reset in the middle of the sixth write
+	zassert_ok(flash_area_write(fa, 5 * RECORD_SIZE, torn, sizeof(torn)));
+
+	at_storage_stats_get(&before);
+	zassert_ok(init_at_storage());
+	at_storage_stats_get(&after);
+	zassert_equal(after.torn - before.torn, 1);
+
+	zassert_ok(append(1));
+	zassert_equal(at_storage_peek(s, ARRAY_SIZE(s)), 6);
+	zassert_equal(sample_seq(&s[4]), 4);
+	zassert_equal(sample_seq(&s[5]), 5);
+
+	zassert_ok(at_storage_consume(6));
+	zassert_equal(at_storage_backlog(), 0);
+}
+
+ZTEST(at_storage, test_wrap_drops_oldest_sector)
+{
+	struct at_storage_stats before, after;
+	uint32_t capacity;
+
+	at_storage_stats_get(&before);
+	capacity = before.capacity;
+	zassert_equal(capacity * RECORD_SIZE, fa->fa_size);
+
+	// A full ring, the head is back at the tail
+	zassert_ok(append(capacity));
+	zassert_equal(at_storage_backlog(), capacity);
+	zassert_equal(first_seq(), 0);
+	zassert_ok(init_at_storage());
+	zassert_equal(at_storage_backlog(), capacity);
+	zassert_equal(first_seq(), 0);
+
+	// The next record erases the first sector
+	zassert_ok(append(1));
+	at_storage_stats_get(&after);
+	zassert_equal(after.overwritten - before.overwritten, SECTOR_RECORDS);
+	zassert_equal(at_storage_backlog(), capacity + 1 - SECTOR_RECORDS);
+	zassert_equal(first_seq(), SECTOR_RECORDS);
+
+	// Same view after a reset
+	zassert_ok(init_at_storage());
+	zassert_equal(at_storage_backlog(), capacity + 1 - SECTOR_RECORDS);
+	zassert_equal(first_seq(), SECTOR_RECORDS);
+
+	zassert_ok(at_storage_consume(capacity + 1 - SECTOR_RECORDS));
+	zassert_equal(at_storage_backlog(), 0);
+}
+
+/* Draining part of the log and wrapping again keeps the newest records */
+ZTEST(at_storage, test_wrap_after_partial_drain)
+{
+	uint32_t capacity;
+	struct at_storage_stats stats;
+
+	at_storage_stats_get(&stats);
+	capacity = stats.capacity;
+
+	zassert_ok(append(capacity));
+	zassert_ok(at_storage_consume(SECTOR_RECORDS + 10));
+
+	// The wrap erases an already drained sector and drops nothing
+	zassert_ok(append(SECTOR_RECORDS));
+	zassert_equal(at_storage_backlog(), capacity - 10);
+	zassert_equal(first_seq(), SECTOR_RECORDS + 10);
+
+	// The next wrap lands on the tail sector and drops what is left of it
+	zassert_ok(append(1));
+	zassert_equal(at_storage_backlog(), capacity + 1 - SECTOR_RECORDS);
+	zassert_equal(first_seq(), 2 * SECTOR_RECORDS);
+}
+
+ZTEST_SUITE(at_storage, NULL, storage_setup, storage_before, NULL, NULL);